@@ -0,0 +1,516 @@
+/*
+* TITLE: Swap benchmark
+* SUBTITLE: Practical 1
+*
+* bench.c:
+    Runs the swap workload of e1 to e4 with every locking strategy behind the same driver. For each
+    strategy and number of threads, the threads perform a fixed total number of swaps, claimed in
+    batches from a global counter as in e4, and the run is reported as one CSV line: throughput,
+    median and 99th percentile of the time spent acquiring the positions, and wall time. The work done
+    inside and outside the critical section is calibrated busy work, not usleep(), so hold times of
+    a few hundred nanoseconds can be modelled. With --batch, each thread applies several swaps at once
+    under lock_set(), which takes all their locks in order, and the wait percentiles are per batch.
+    --pin places the threads on fixed CPUs, and each thread first-touches its own part of the buffer.
+    Sizes are 64-bit, and --mmap keeps the buffer in a file, for buffers larger than the heap can hold
+    comfortably and to keep the final permutation. --distribution skews the picked positions (Zipfian
+    or hot spot), and --counts writes how many times each position was accessed in each run.
+    --acquire=retry|repick replaces the blocking, ordered acquisition with trylock and randomized
+    exponential backoff, to compare tail latencies without convoys behind slow holders.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include "affinity.h"
+#include "dist.h"
+#include "hist.h"
+#include "locks.h"
+#include "options.h"
+#include "rng.h"
+#include "verify.h"
+#include "work.h"
+
+#define ITER_BATCH 64                     // Iterations claimed from globalIter at a time by each thread
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)  // Anonymous huge page mappings are rounded up to this size
+#define MIN_BACKOFF_SPINS 16              // Range of the random backoff of --acquire=retry|repick
+#define MAX_BACKOFF_SPINS 4096
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() atomic_signal_fence(memory_order_seq_cst)
+#endif
+
+static const char *acquire_names[] = {
+    [ACQUIRE_BLOCKING] = "blocking",
+    [ACQUIRE_RETRY]    = "retry",
+    [ACQUIRE_REPICK]   = "repick",
+};
+
+// Buffer element. 64 bits, so buffers can have more than 2^31 positions
+typedef int64_t elem_t;
+
+// Shared buffer of a run
+struct buffer {
+    elem_t *data;
+    long size;
+    size_t mapped;               // Bytes mapped with mmap() (0: data comes from malloc())
+    const char *memory;          // Where data lives: heap, file, hugetlb or thp
+    struct lock_table locks;
+    const struct dist *dist;     // Distribution of the swapped positions
+    uint32_t *counts;            // Accesses to each position, updated while holding it (NULL: not counted)
+    atomic_long globalIter;      // Iterations not claimed yet
+    pthread_barrier_t start;     // Threads and main start the run together
+};
+
+// Arguments and results of each thread
+struct args {
+    pthread_t       thread_id;
+    int             thread_num;
+    int             num_threads;
+    int             delay;       // delay between operations (in microseconds)
+    int             work_ns;     // busy work inside the critical section
+    int             think_ns;    // busy work between swaps
+    int             batch;       // swaps applied under a single lock_set()
+    int             acquire;     // enum acquire_mode
+    unsigned long   seed;        // seed of the position generator
+    struct buffer   *buffer;
+    long            ops;         // swaps performed
+    long            retries;     // failed trylock attempts
+    long            aborts;      // positions given up for new ones (--acquire=repick)
+    uint64_t        start, end;  // when the thread started and finished swapping
+    struct hist     wait;        // time spent getting the positions, in ns
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Spin for a random time below *cap, doubling *cap for the next failure. Randomness keeps threads that failed
+// together from retrying together. Past MAX_BACKOFF_SPINS, yield the CPU instead
+static void backoff(struct rng *rng, unsigned *cap)
+{
+    unsigned spins;
+
+    if (*cap > MAX_BACKOFF_SPINS) {
+        sched_yield();
+        return;
+    }
+    spins = rng_below(rng, *cap);
+    for (unsigned k = 0; k < spins; k++)
+        cpu_relax();
+    *cap <<= 1;
+}
+
+// Get exclusive access to pos[0..n) as selected by --acquire. With repick, the positions that could not be
+// taken are replaced in pos by new ones. held receives the locks to pass to unlock_set(), and their number
+// is returned
+static int acquire(struct args *args, struct rng *rng, long *pos, int n, long *held)
+{
+    struct buffer *buffer = args->buffer;
+    unsigned cap = MIN_BACKOFF_SPINS;
+    int num_held;
+
+    if (args->acquire == ACQUIRE_BLOCKING)
+        return lock_set(&buffer->locks, pos, n, held);
+
+    while ((num_held = trylock_set(&buffer->locks, pos, n, held)) < 0) {
+        args->retries++;
+        if (args->acquire == ACQUIRE_REPICK) {
+            args->aborts += n;    // Every position of the set is given up, not only the one that failed
+            for (int k = 0; k < n; k++)
+                pos[k] = dist_sample(buffer->dist, rng);
+        }
+        backoff(rng, &cap);
+    }
+    return num_held;
+}
+
+// Apply n random swaps as a single update: lock every position they touch at once, then swap them in order.
+// Returns the number of swaps done
+static int swap_batch(struct args *args, struct rng *rng, int n)
+{
+    struct buffer *buffer = args->buffer;
+    long pos[MAX_LOCK_SET];    // Positions of swap k: pos[2k] and pos[2k + 1]
+    long held[MAX_LOCK_SET];
+    int num_held, k;
+    elem_t tmp;
+    uint64_t t0;
+
+    for (k = 0; k < 2 * n; k++)
+        pos[k] = dist_sample(buffer->dist, rng);
+
+    t0 = now_ns();
+    num_held = acquire(args, rng, pos, 2 * n, held);
+    hist_record(&args->wait, now_ns() - t0);
+
+    if (buffer->counts != NULL) {
+        for (k = 0; k < 2 * n; k++)
+            buffer->counts[pos[k]]++;
+    }
+    for (k = 0; k < n; k++) {
+        tmp = buffer->data[pos[2 * k]];
+        buffer->data[pos[2 * k]] = buffer->data[pos[2 * k + 1]];
+        buffer->data[pos[2 * k + 1]] = tmp;
+        if (args->delay) usleep(args->delay);
+        work_ns(args->work_ns);
+    }
+
+    unlock_set(&buffer->locks, held, num_held);
+    args->ops += n;
+
+    work_ns(args->think_ns * n);
+    return n;
+}
+
+// Function executed by each thread, swapping random positions until the run's iterations are used up
+void *swap(void *ptr)
+{
+    struct args *args = ptr;
+    struct buffer *buffer = args->buffer;
+    struct rng rng;
+    long claimed = 0;   // Iterations left in the batch claimed by this thread
+    long i, j;
+    long pos[2], held[2];
+    int num_held = 0;
+    elem_t tmp;
+    uint64_t t0;
+
+    rng_seed(&rng, args->seed, args->thread_num);
+    hist_reset(&args->wait);
+    args->ops = 0;
+    args->retries = 0;
+    args->aborts = 0;
+
+    // Initialize this thread's part of the buffer, so its pages are allocated on the thread's NUMA node
+    long lo = buffer->size / args->num_threads * args->thread_num;
+    long hi = args->thread_num == args->num_threads - 1 ? buffer->size : lo + buffer->size / args->num_threads;
+    for (i = lo; i < hi; i++)
+        buffer->data[i] = i;
+
+    pthread_barrier_wait(&buffer->start);
+    args->start = now_ns();
+
+    while (1) {
+        if (claimed == 0) {
+            long left = atomic_fetch_sub_explicit(&buffer->globalIter, ITER_BATCH, memory_order_relaxed);
+            if (left <= 0)
+                break;
+            claimed = left < ITER_BATCH ? left : ITER_BATCH;
+        }
+
+        if (args->batch > 1) {
+            claimed -= swap_batch(args, &rng, claimed < args->batch ? claimed : args->batch);
+            continue;
+        }
+        claimed--;
+
+        i = dist_sample(buffer->dist, &rng);
+        j = dist_sample(buffer->dist, &rng);
+
+        t0 = now_ns();
+        if (args->acquire == ACQUIRE_BLOCKING) {
+            lock_pair(&buffer->locks, i, j);
+        } else {
+            pos[0] = i;
+            pos[1] = j;
+            num_held = acquire(args, &rng, pos, 2, held);
+            i = pos[0];
+            j = pos[1];
+        }
+        hist_record(&args->wait, now_ns() - t0);
+
+        if (buffer->counts != NULL) {
+            buffer->counts[i]++;
+            buffer->counts[j]++;
+        }
+
+        tmp = buffer->data[i];
+        if (args->delay) usleep(args->delay);
+
+        buffer->data[i] = buffer->data[j];
+        if (args->delay) usleep(args->delay);
+
+        buffer->data[j] = tmp;
+        if (args->delay) usleep(args->delay);
+        work_ns(args->work_ns);
+
+        if (args->acquire == ACQUIRE_BLOCKING)
+            unlock_pair(&buffer->locks, i, j);
+        else
+            unlock_set(&buffer->locks, held, num_held);
+        args->ops++;
+
+        work_ns(args->think_ns);
+    }
+    args->end = now_ns();
+    return NULL;
+}
+
+// Allocate the buffer data: in the file given with --mmap, in huge pages with --hugepages (never both), or with
+// malloc().
+// The pages are not touched here; each thread initializes its own part
+static void alloc_data(struct options *opt, struct buffer *buffer)
+{
+    size_t bytes = buffer->size * sizeof(elem_t);
+    int fd;
+
+    buffer->mapped = 0;
+    if (opt->mmap_file == NULL && !opt->hugepages) {
+        buffer->memory = "heap";
+        buffer->data = malloc(bytes);
+        if (buffer->data == NULL) {
+            printf("Not enough memory\n");
+            exit(1);
+        }
+        return;
+    }
+
+    if (opt->mmap_file != NULL) {
+        buffer->memory = "file";
+        fd = open(opt->mmap_file, O_RDWR | O_CREAT, 0644);
+        if (fd < 0 || ftruncate(fd, bytes) != 0) {
+            printf("Could not create %s: %s\n", opt->mmap_file, strerror(errno));
+            exit(1);
+        }
+        buffer->data = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+
+        // Swaps touch random positions, so reading ahead only wastes I/O
+        if (buffer->data != MAP_FAILED)
+            madvise(buffer->data, bytes, MADV_RANDOM);
+    } else {
+        // Reserved huge pages if the system has them, otherwise ask for transparent huge pages
+        bytes = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        buffer->memory = "hugetlb";
+        buffer->data = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (buffer->data == MAP_FAILED) {
+            buffer->memory = "thp";
+            buffer->data = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (buffer->data != MAP_FAILED)
+                madvise(buffer->data, bytes, MADV_HUGEPAGE);
+        }
+    }
+    if (buffer->data == MAP_FAILED) {
+        printf("Could not map the buffer: %s\n", strerror(errno));
+        exit(1);
+    }
+    buffer->mapped = bytes;
+}
+
+// Release the buffer data. A file mapping is written back first, so the file holds the final permutation
+static void free_data(struct buffer *buffer)
+{
+    if (buffer->mapped == 0) {
+        free(buffer->data);
+        return;
+    }
+    if (strcmp(buffer->memory, "file") == 0)
+        msync(buffer->data, buffer->mapped, MS_SYNC);
+    munmap(buffer->data, buffer->mapped);
+}
+
+// Run the workload once with the given strategy and number of threads, and print its CSV line
+static void run(struct options *opt, struct affinity *aff, const struct dist *dist, FILE *counts,
+                FILE *thread_stats, int strategy, int num_threads)
+{
+    pthread_attr_t attr;
+    struct buffer buffer;
+    struct args *args;
+    struct hist wait;
+    uint64_t start, end;
+    long ops = 0, retries = 0, aborts = 0;
+    double wall;
+    const char *verified = "-";
+    int i;
+
+    buffer.size = opt->buffer_size;
+    alloc_data(opt, &buffer);
+    buffer.dist = dist;
+    buffer.counts = NULL;
+    if (counts != NULL)
+        buffer.counts = calloc(buffer.size, sizeof(uint32_t));
+    args = malloc(num_threads * sizeof(struct args));
+    if (args == NULL || (counts != NULL && buffer.counts == NULL)) {
+        printf("Not enough memory\n");
+        exit(1);
+    }
+
+    lock_table_init(&buffer.locks, strategy, buffer.size, opt->lock_stripes);
+    atomic_init(&buffer.globalIter, opt->iterations);
+    pthread_barrier_init(&buffer.start, NULL, num_threads + 1);
+
+    for (i = 0; i < num_threads; i++) {
+        args[i].thread_num = i;
+        args[i].num_threads = num_threads;
+        args[i].delay      = opt->delay;
+        args[i].work_ns    = opt->work_ns;
+        args[i].think_ns   = opt->think_ns;
+        args[i].batch      = opt->batch;
+        args[i].acquire    = opt->acquire;
+        args[i].seed       = opt->seed;
+        args[i].buffer     = &buffer;
+
+        affinity_attr(aff, i, &attr);
+        if (pthread_create(&args[i].thread_id, &attr, swap, &args[i]) != 0) {
+            printf("Could not create thread #%d", i);
+            exit(1);
+        }
+        pthread_attr_destroy(&attr);
+    }
+
+    // Start the run once every thread is ready and has initialized its part of the buffer
+    pthread_barrier_wait(&buffer.start);
+    for (i = 0; i < num_threads; i++)
+        pthread_join(args[i].thread_id, NULL);
+
+    // The run lasts from the first thread starting to the last one finishing
+    hist_reset(&wait);
+    start = args[0].start;
+    end = args[0].end;
+    for (i = 0; i < num_threads; i++) {
+        hist_merge(&wait, &args[i].wait);
+        ops += args[i].ops;
+        retries += args[i].retries;
+        aborts += args[i].aborts;
+        if (args[i].start < start)
+            start = args[i].start;
+        if (args[i].end > end)
+            end = args[i].end;
+    }
+    wall = (end - start) / 1e9;
+
+    if (opt->verify)
+        verified = verify_permutation(buffer.data, sizeof(elem_t), buffer.size, num_threads) < 0 ? "pass" : "fail";
+
+    printf("%s,%d,%s,%s,%ld,%s,%ld,%d,%s,%d,%d,%ld,%.6f,%.0f,%llu,%llu,%llu,%ld,%ld,%s\n",
+           lock_strategy_name(strategy), num_threads, opt->pin, buffer.memory, buffer.size, opt->distribution,
+           buffer.locks.num_locks, opt->batch, acquire_names[opt->acquire], opt->work_ns, opt->think_ns,
+           ops, wall, ops / wall,
+           (unsigned long long) hist_percentile(&wait, 0.50),
+           (unsigned long long) hist_percentile(&wait, 0.99),
+           (unsigned long long) hist_percentile(&wait, 0.999), retries, aborts, verified);
+    fflush(stdout);
+
+    if (thread_stats != NULL) {
+        for (i = 0; i < num_threads; i++) {
+            fprintf(thread_stats, "%s,%d,%d,%ld,%ld,%ld,%llu,%llu\n", lock_strategy_name(strategy), num_threads, i,
+                    args[i].ops, args[i].retries, args[i].aborts,
+                    (unsigned long long) hist_percentile(&args[i].wait, 0.99),
+                    (unsigned long long) hist_percentile(&args[i].wait, 0.999));
+        }
+    }
+
+    if (counts != NULL) {
+        for (long k = 0; k < buffer.size; k++) {
+            if (buffer.counts[k] > 0)
+                fprintf(counts, "%s,%d,%ld,%u\n", lock_strategy_name(strategy), num_threads, k, buffer.counts[k]);
+        }
+        free(buffer.counts);
+    }
+
+    pthread_barrier_destroy(&buffer.start);
+    lock_table_destroy(&buffer.locks);
+    free_data(&buffer);
+    free(args);
+}
+
+int main (int argc, char **argv)
+{
+    struct options opt;
+    struct affinity aff;
+    struct dist dist;
+    FILE *counts = NULL, *thread_stats = NULL;
+    int stripes;
+
+    // Default values for the options
+    opt.thread_counts[0] = 1;
+    opt.thread_counts[1] = 2;
+    opt.thread_counts[2] = 4;
+    opt.thread_counts[3] = 8;
+    opt.num_thread_counts = 4;
+    for (opt.num_strategies = 0; opt.num_strategies < NUM_LOCK_STRATEGIES; opt.num_strategies++)
+        opt.strategies[opt.num_strategies] = opt.num_strategies;
+    opt.buffer_size  = 1024;
+    opt.iterations   = 1000000;
+    opt.delay        = 0;
+    opt.work_ns      = 0;
+    opt.think_ns     = 0;
+    opt.batch        = 1;
+    opt.acquire      = ACQUIRE_BLOCKING;
+    opt.thread_stats = NULL;
+    opt.lock_stripes = 64;
+    opt.distribution = "uniform";
+    opt.counts_file  = NULL;
+    opt.mmap_file    = NULL;
+    opt.hugepages    = 0;
+    opt.pin          = "none";
+    opt.seed         = time(NULL);
+    opt.verify       = 0;
+    opt.header       = 1;
+
+    read_options(argc, argv, &opt);
+
+    // The striped strategy hashes positions with a mask
+    for (stripes = 1; stripes < opt.lock_stripes; stripes <<= 1)
+        ;
+    opt.lock_stripes = stripes;
+
+    if (affinity_init(&aff, opt.pin) != 0) {
+        printf("'%s': is not a valid placement\n", opt.pin);
+        exit(1);
+    }
+
+    if (dist_init(&dist, opt.distribution, opt.buffer_size) != 0) {
+        printf("'%s': is not a valid distribution\n", opt.distribution);
+        exit(1);
+    }
+    if (opt.counts_file != NULL) {
+        if ((counts = fopen(opt.counts_file, "w")) == NULL) {
+            printf("Could not create %s\n", opt.counts_file);
+            exit(1);
+        }
+        fprintf(counts, "strategy,threads,position,accesses\n");
+    }
+    if (opt.thread_stats != NULL) {
+        if ((thread_stats = fopen(opt.thread_stats, "w")) == NULL) {
+            printf("Could not create %s\n", opt.thread_stats);
+            exit(1);
+        }
+        fprintf(thread_stats, "strategy,threads,thread,ops,retries,aborts,wait_p99_ns,wait_p999_ns\n");
+    }
+
+    printf("# seed: %lu\n", opt.seed);
+    affinity_print(&aff, stdout, "# ");
+    if (opt.work_ns > 0 || opt.think_ns > 0) {
+        work_calibrate();
+        printf("# work loop: %.0f iterations/us\n", work_rate());
+    }
+    if (opt.header)
+        printf("strategy,threads,pin,memory,buffer_size,distribution,locks,batch,acquire,work_ns,think_ns,ops,wall_s,ops_per_s,wait_p50_ns,wait_p99_ns,wait_p999_ns,retries,aborts,verify\n");
+
+    for (int s = 0; s < opt.num_strategies; s++) {
+        for (int t = 0; t < opt.num_thread_counts; t++)
+            run(&opt, &aff, &dist, counts, thread_stats, opt.strategies[s], opt.thread_counts[t]);
+    }
+
+    if (counts != NULL)
+        fclose(counts);
+    if (thread_stats != NULL)
+        fclose(thread_stats);
+    affinity_destroy(&aff);
+    return 0;
+}
@@ -0,0 +1,289 @@
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "locks.h"
+
+#define MAX_BACKOFF_SPINS 1024
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() atomic_signal_fence(memory_order_seq_cst)
+#endif
+
+static const char *strategy_names[NUM_LOCK_STRATEGIES] = {
+    [LOCK_GLOBAL]       = "global",
+    [LOCK_PER_POSITION] = "per-position",
+    [LOCK_STRIPED]      = "striped",
+    [LOCK_LOCKFREE]     = "lockfree",
+};
+
+const char *lock_strategy_name(int strategy)
+{
+    return strategy_names[strategy];
+}
+
+int lock_strategy_parse(const char *name)
+{
+    for (int s = 0; s < NUM_LOCK_STRATEGIES; s++) {
+        if (strcmp(name, strategy_names[s]) == 0)
+            return s;
+    }
+    return -1;
+}
+
+void lock_table_init(struct lock_table *t, int strategy, long size, int stripes)
+{
+    long i;
+
+    t->strategy = strategy;
+    t->mutexes = NULL;
+    t->stripes = NULL;
+    t->owners = NULL;
+
+    switch (strategy) {
+    case LOCK_GLOBAL:
+    case LOCK_PER_POSITION:
+        t->num_locks = strategy == LOCK_GLOBAL ? 1 : size;
+        t->mutexes = malloc(t->num_locks * sizeof(pthread_mutex_t));
+        if (t->mutexes == NULL) {
+            printf("Out of memory for the mutexes\n");
+            exit(1);
+        }
+        for (i = 0; i < t->num_locks; i++)
+            pthread_mutex_init(&t->mutexes[i], NULL);
+        break;
+
+    case LOCK_STRIPED:
+        t->num_locks = stripes;
+        t->stripes = aligned_alloc(CACHE_LINE_SIZE, t->num_locks * sizeof(struct lock_stripe));
+        if (t->stripes == NULL) {
+            printf("Out of memory for the lock stripes\n");
+            exit(1);
+        }
+        for (i = 0; i < t->num_locks; i++)
+            pthread_mutex_init(&t->stripes[i].m, NULL);
+        break;
+
+    case LOCK_LOCKFREE:
+        t->num_locks = size;
+        t->owners = calloc(t->num_locks, sizeof(atomic_uint));
+        if (t->owners == NULL) {
+            printf("Out of memory for the ownership words\n");
+            exit(1);
+        }
+        break;
+    }
+}
+
+void lock_table_destroy(struct lock_table *t)
+{
+    long i;
+
+    if (t->mutexes != NULL) {
+        for (i = 0; i < t->num_locks; i++)
+            pthread_mutex_destroy(&t->mutexes[i]);
+    }
+    if (t->stripes != NULL) {
+        for (i = 0; i < t->num_locks; i++)
+            pthread_mutex_destroy(&t->stripes[i].m);
+    }
+    free(t->mutexes);
+    free(t->stripes);
+    free(t->owners);
+}
+
+// Index of the lock protecting position pos
+static long lock_index(struct lock_table *t, long pos)
+{
+    switch (t->strategy) {
+    case LOCK_GLOBAL:
+        return 0;
+    case LOCK_STRIPED:
+        return pos & (t->num_locks - 1);
+    default:
+        return pos;
+    }
+}
+
+// Lock with the given index
+static pthread_mutex_t *lock_at(struct lock_table *t, long idx)
+{
+    if (t->stripes != NULL)
+        return &t->stripes[idx].m;
+    return &t->mutexes[idx];
+}
+
+// Spin for a while after a failed claim, doubling the wait each time. Once the limit is reached, yield the CPU
+static void backoff(unsigned *spins)
+{
+    unsigned k;
+
+    if (*spins >= MAX_BACKOFF_SPINS) {
+        sched_yield();
+        return;
+    }
+    for (k = 0; k < *spins; k++)
+        cpu_relax();
+    *spins <<= 1;
+}
+
+// Try to take ownership of position pos. Free positions hold an even version, owned ones an odd version
+static bool claim_slot(struct lock_table *t, long pos)
+{
+    unsigned v = atomic_load_explicit(&t->owners[pos], memory_order_relaxed);
+
+    return (v & 1) == 0
+        && atomic_compare_exchange_strong_explicit(&t->owners[pos], &v, v + 1,
+                               memory_order_acquire, memory_order_relaxed);
+}
+
+// Give position pos back, moving its version to the next even value
+static void release_slot(struct lock_table *t, long pos)
+{
+    atomic_fetch_add_explicit(&t->owners[pos], 1, memory_order_release);
+}
+
+// Claim positions i and j in address order. If the second one is taken, drop the first and back off
+static void claim_pair(struct lock_table *t, long i, long j)
+{
+    long lo = i < j ? i : j;
+    long hi = i < j ? j : i;
+    unsigned spins = 1;
+
+    while (1) {
+        if (claim_slot(t, lo)) {
+            if (lo == hi || claim_slot(t, hi))
+                return;
+            release_slot(t, lo);
+        }
+        backoff(&spins);
+    }
+}
+
+void lock_pair(struct lock_table *t, long i, long j)
+{
+    long li, lj;
+
+    if (t->strategy == LOCK_LOCKFREE) {
+        claim_pair(t, i, j);
+        return;
+    }
+
+    li = lock_index(t, i);
+    lj = lock_index(t, j);
+
+    // Acquire in index order to avoid a circular wait between threads
+    if (li == lj) {
+        pthread_mutex_lock(lock_at(t, li));
+    } else if (li < lj) {
+        pthread_mutex_lock(lock_at(t, li));
+        pthread_mutex_lock(lock_at(t, lj));
+    } else {
+        pthread_mutex_lock(lock_at(t, lj));
+        pthread_mutex_lock(lock_at(t, li));
+    }
+}
+
+void unlock_pair(struct lock_table *t, long i, long j)
+{
+    long li, lj;
+
+    if (t->strategy == LOCK_LOCKFREE) {
+        release_slot(t, i);
+        if (i != j)
+            release_slot(t, j);
+        return;
+    }
+
+    li = lock_index(t, i);
+    lj = lock_index(t, j);
+
+    pthread_mutex_unlock(lock_at(t, li));
+    if (li != lj)
+        pthread_mutex_unlock(lock_at(t, lj));
+}
+
+// Sort the n lock indexes in idx and drop the repeated ones. Returns the number left. Sets are small, so
+// insertion sort is enough
+static int sort_unique(long *idx, int n)
+{
+    long v;
+    int i, j, m = 0;
+
+    for (i = 1; i < n; i++) {
+        v = idx[i];
+        for (j = i; j > 0 && idx[j - 1] > v; j--)
+            idx[j] = idx[j - 1];
+        idx[j] = v;
+    }
+    for (i = 0; i < n; i++) {
+        if (m == 0 || idx[i] != idx[m - 1])
+            idx[m++] = idx[i];
+    }
+    return m;
+}
+
+// Fill held with the sorted, distinct locks that protect pos[0..n). Returns their number
+static int collect_locks(struct lock_table *t, const long *pos, int n, long *held)
+{
+    for (int i = 0; i < n; i++)
+        held[i] = t->strategy == LOCK_LOCKFREE ? pos[i] : lock_index(t, pos[i]);
+    return sort_unique(held, n);
+}
+
+int lock_set(struct lock_table *t, const long *pos, int n, long *held)
+{
+    unsigned spins = 1;
+    int i, k;
+
+    n = collect_locks(t, pos, n, held);
+
+    if (t->strategy != LOCK_LOCKFREE) {
+        for (i = 0; i < n; i++)
+            pthread_mutex_lock(lock_at(t, held[i]));
+        return n;
+    }
+
+    // Claim the positions in order. If one is taken, give back the ones already claimed and back off
+    while (1) {
+        for (i = 0; i < n && claim_slot(t, held[i]); i++)
+            ;
+        if (i == n)
+            return n;
+        for (k = 0; k < i; k++)
+            release_slot(t, held[k]);
+        backoff(&spins);
+    }
+}
+
+void unlock_set(struct lock_table *t, const long *held, int n)
+{
+    for (int i = 0; i < n; i++) {
+        if (t->strategy == LOCK_LOCKFREE)
+            release_slot(t, held[i]);
+        else
+            pthread_mutex_unlock(lock_at(t, held[i]));
+    }
+}
+
+int trylock_set(struct lock_table *t, const long *pos, int n, long *held)
+{
+    bool taken;
+    int i;
+
+    n = collect_locks(t, pos, n, held);
+    for (i = 0; i < n; i++) {
+        if (t->strategy == LOCK_LOCKFREE)
+            taken = claim_slot(t, held[i]);
+        else
+            taken = pthread_mutex_trylock(lock_at(t, held[i])) == 0;
+        if (!taken) {
+            unlock_set(t, held, i);
+            return -1;
+        }
+    }
+    return n;
+}
@@ -0,0 +1,60 @@
+#ifndef __LOCKS_H__
+#define __LOCKS_H__
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+
+/*
+ * locks.c and locks.h:
+ * The locking strategies of the swap programs (e1 to e4) behind a single
+ * interface, so the benchmark can run all of them with the same driver.
+ */
+
+#define CACHE_LINE_SIZE 64
+#define MAX_LOCK_SET    256   // Positions that lock_set() can take at once
+
+enum lock_strategy {
+	LOCK_GLOBAL,        // one mutex for the whole buffer (e1)
+	LOCK_PER_POSITION,  // one mutex per position (e2, e3)
+	LOCK_STRIPED,       // table of cache-line aligned mutexes shared by positions
+	LOCK_LOCKFREE,      // atomic ownership word per position, claimed with compare-and-swap
+	NUM_LOCK_STRATEGIES
+};
+
+// Mutex padded to a whole cache line, so two stripes never share one
+struct lock_stripe {
+	alignas(CACHE_LINE_SIZE) pthread_mutex_t m;
+};
+
+struct lock_table {
+	int strategy;                  // enum lock_strategy
+	long num_locks;                // Number of locks (1 for LOCK_GLOBAL)
+	pthread_mutex_t *mutexes;      // LOCK_GLOBAL and LOCK_PER_POSITION
+	struct lock_stripe *stripes;   // LOCK_STRIPED
+	atomic_uint *owners;           // LOCK_LOCKFREE: odd while the position is owned
+};
+
+// Create the locks for a buffer of size positions. stripes is only used by LOCK_STRIPED and must be a power of two
+void lock_table_init(struct lock_table *t, int strategy, long size, int stripes);
+void lock_table_destroy(struct lock_table *t);
+
+// Get and release exclusive access to positions i and j, without deadlocks between threads
+void lock_pair(struct lock_table *t, long i, long j);
+void unlock_pair(struct lock_table *t, long i, long j);
+
+// Get exclusive access to every position in pos[0..n), n <= MAX_LOCK_SET, for a multi-position update. The locks
+// are taken once each and in increasing order, so any two sets can be locked concurrently without deadlocks.
+// held receives the locks taken (MAX_LOCK_SET entries), and the return value is the number to pass to unlock_set()
+int lock_set(struct lock_table *t, const long *pos, int n, long *held);
+void unlock_set(struct lock_table *t, const long *held, int n);
+
+// Like lock_set(), but without waiting: if any lock is taken, the ones already acquired are released and -1 is
+// returned
+int trylock_set(struct lock_table *t, const long *pos, int n, long *held);
+
+// Name of a strategy, and strategy with a given name (-1 if there is none)
+const char *lock_strategy_name(int strategy);
+int lock_strategy_parse(const char *name);
+
+#endif
@@ -0,0 +1,375 @@
+#include <getopt.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "options.h"
+
+static struct option long_options[] = {
+    { .name = "threads",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 't'},
+    { .name = "strategy",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'S'},
+    { .name = "buffer_size",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'b'},
+    { .name = "iterations",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'i'},
+    { .name = "delay",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'd'},
+    { .name = "work-ns",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'w'},
+    { .name = "think-ns",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'k'},
+    { .name = "batch",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'B'},
+    { .name = "acquire",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'a'},
+    { .name = "thread-stats",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'x'},
+    { .name = "lock-stripes",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 's'},
+    { .name = "distribution",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'D'},
+    { .name = "counts",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'c'},
+    { .name = "mmap",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'm'},
+    { .name = "hugepages",
+      .has_arg = no_argument,
+      .flag = NULL,
+      .val = 'g'},
+    { .name = "pin",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'P'},
+    { .name = "seed",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'r'},
+    { .name = "verify",
+      .has_arg = no_argument,
+      .flag = NULL,
+      .val = 'v'},
+    { .name = "no-header",
+      .has_arg = no_argument,
+      .flag = NULL,
+      .val = 'H'},
+    { .name = "help",
+      .has_arg = no_argument,
+      .flag = NULL,
+      .val = 'h'},
+    {0, 0, 0, 0}
+};
+
+static void usage(int i)
+{
+    printf(
+        "Usage:  swap_bench [OPTION]\n"
+        "Runs the swap workload once for each strategy and number of threads,\n"
+        "printing one CSV line per run.\n"
+        "Options:\n"
+        "  -t l, --threads=<l>: comma separated numbers of threads (default: 1,2,4,8)\n"
+        "  -S l, --strategy=<l>: comma separated strategies: global, per-position,\n"
+        "                        striped, lockfree or all (default: all)\n"
+        "  -b n, --buffer_size=<n>: size of buffer\n"
+        "  -i n, --iterations=<n>: total number of swaps of each run\n"
+        "  -d n, --delay=<n>: delay between buffer ops (us)\n"
+        "  -w n, --work-ns=<n>: busy work inside the critical section (ns)\n"
+        "  -k n, --think-ns=<n>: busy work between swaps (ns)\n"
+        "  -B n, --batch=<n>: apply n swaps at once, locking all their positions together\n"
+        "  -a m, --acquire=<m>: blocking (default) locks in order; retry and repick use trylock,\n"
+        "                       backing off for a random time on failure, and then try the\n"
+        "                       same positions again (retry) or pick new ones (repick)\n"
+        "  -x f, --thread-stats=<f>: write the swaps, retries and aborts of each thread to f\n"
+        "  -s n, --lock-stripes=<n>: locks of the striped strategy (rounded up to a power of two)\n"
+        "  -D d, --distribution=<d>: positions picked: uniform (default), zipf:θ (0 < θ < 1)\n"
+        "                            or hotspot:f[:p] (fraction p of the accesses to the first\n"
+        "                            f of the buffer, p = 0.8 by default)\n"
+        "  -c f, --counts=<f>: count the accesses to each position and write them to f\n"
+        "  -m f, --mmap=<f>: keep the buffer in file f (an array of 64-bit integers),\n"
+        "                    which holds the final permutation of the last run\n"
+        "  -g, --hugepages: back the buffer with huge pages when possible\n"
+        "  -P p, --pin=<p>: pin threads: none (default), compact, scatter or a cpu list (0-3,8)\n"
+        "  -r n, --seed=<n>: seed for the position generators (default: current time)\n"
+        "  -v, --verify: check that the buffer is still a permutation after each run\n"
+        "  -H, --no-header: do not print the CSV header\n"
+        "  -h, --help: this message\n\n"
+    );
+    exit(i);
+}
+
+static int get_int(char *arg, int *value)
+{
+    char *end;
+    *value = strtol(arg, &end, 10);
+
+    return (end != arg && *end == '\0');
+}
+
+static int get_long(char *arg, long *value)
+{
+    char *end;
+    *value = strtol(arg, &end, 10);
+
+    return (end != arg && *end == '\0');
+}
+
+static int get_ulong(char *arg, unsigned long *value)
+{
+    char *end;
+    *value = strtoul(arg, &end, 10);
+
+    return (end != arg && *end == '\0');
+}
+
+// Parse a comma separated list of positive integers into values. Returns the number of values, or -1
+static int get_int_list(char *arg, int *values, int max)
+{
+    char *end;
+    int n = 0;
+
+    while (*arg != '\0') {
+        if (n == max)
+            return -1;
+        values[n] = strtol(arg, &end, 10);
+        if (end == arg || values[n] <= 0 || (*end != ',' && *end != '\0'))
+            return -1;
+        n++;
+        arg = *end == ',' ? end + 1 : end;
+    }
+    return n;
+}
+
+// Parse a comma separated list of strategy names. Returns the number of strategies, or -1
+static int get_strategy_list(char *arg, int *strategies)
+{
+    char *name;
+    int n = 0;
+
+    if (strcmp(arg, "all") == 0) {
+        for (n = 0; n < NUM_LOCK_STRATEGIES; n++)
+            strategies[n] = n;
+        return n;
+    }
+    for (name = strtok(arg, ","); name != NULL; name = strtok(NULL, ",")) {
+        if (n == NUM_LOCK_STRATEGIES || (strategies[n] = lock_strategy_parse(name)) < 0)
+            return -1;
+        n++;
+    }
+    return n;
+}
+
+int handle_options(int argc, char **argv, struct options *opt)
+{
+    while (1) {
+        int c;
+        int option_index = 0;
+
+        c = getopt_long (argc, argv, "hvt:S:b:i:d:w:k:B:a:x:s:D:c:m:gP:r:H",
+                 long_options, &option_index);
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 't':
+            if ((opt->num_thread_counts = get_int_list(optarg, opt->thread_counts, MAX_THREAD_COUNTS)) <= 0) {
+                printf("'%s': is not a valid list of integers\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'S':
+            if ((opt->num_strategies = get_strategy_list(optarg, opt->strategies)) <= 0) {
+                printf("'%s': is not a valid list of strategies\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'b':
+            if (!get_long(optarg, &opt->buffer_size)
+                || opt->buffer_size <= 0) {
+                printf("'%s': is not a valid integer\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'i':
+            if (!get_long(optarg, &opt->iterations)
+                || opt->iterations <= 0) {
+                printf("'%s': is not a valid integer\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'd':
+            if (!get_int(optarg, &opt->delay)
+                || opt->delay < 0) {
+                printf("'%s': is not a valid integer\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'w':
+            if (!get_int(optarg, &opt->work_ns)
+                || opt->work_ns < 0) {
+                printf("'%s': is not a valid integer\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'k':
+            if (!get_int(optarg, &opt->think_ns)
+                || opt->think_ns < 0) {
+                printf("'%s': is not a valid integer\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'B':
+            if (!get_int(optarg, &opt->batch)
+                || opt->batch <= 0 || 2 * opt->batch > MAX_LOCK_SET) {
+                printf("'%s': is not a valid batch size (1 to %d)\n",
+                       optarg, MAX_LOCK_SET / 2);
+                usage(-3);
+            }
+            break;
+
+        case 'a':
+            if (strcmp(optarg, "blocking") == 0) {
+                opt->acquire = ACQUIRE_BLOCKING;
+            } else if (strcmp(optarg, "retry") == 0) {
+                opt->acquire = ACQUIRE_RETRY;
+            } else if (strcmp(optarg, "repick") == 0) {
+                opt->acquire = ACQUIRE_REPICK;
+            } else {
+                printf("'%s': is not a valid acquire mode\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'x':
+            opt->thread_stats = optarg;
+            break;
+
+        case 's':
+            if (!get_int(optarg, &opt->lock_stripes)
+                || opt->lock_stripes <= 0) {
+                printf("'%s': is not a valid integer\n",
+                       optarg);
+                usage(-3);
+            }
+            // The table is rounded up to a power of two, which must still fit in an int
+            if (opt->lock_stripes > MAX_LOCK_STRIPES) {
+                printf("'%s': too many lock stripes (at most %d)\n",
+                       optarg, MAX_LOCK_STRIPES);
+                usage(-3);
+            }
+            break;
+
+        case 'D':
+            opt->distribution = optarg;
+            break;
+
+        case 'c':
+            opt->counts_file = optarg;
+            break;
+
+        case 'm':
+            opt->mmap_file = optarg;
+            break;
+
+        case 'g':
+            opt->hugepages = 1;
+            break;
+
+        case 'P':
+            opt->pin = optarg;
+            break;
+
+        case 'r':
+            if (!get_ulong(optarg, &opt->seed)) {
+                printf("'%s': is not a valid integer\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'v':
+            opt->verify = 1;
+            break;
+
+        case 'H':
+            opt->header = 0;
+            break;
+
+        case '?':
+        case 'h':
+            usage(0);
+            break;
+
+        default:
+            printf ("?? getopt returned character code 0%o ??\n", c);
+            usage(-1);
+        }
+    }
+    return 0;
+}
+
+int read_options(int argc, char **argv, struct options *opt) {
+
+    int result = handle_options(argc,argv,opt);
+
+    if (result != 0)
+        exit(result);
+
+    if (argc - optind != 0) {
+        printf ("Too many arguments\n\n");
+        while (optind < argc)
+            printf ("'%s' ", argv[optind++]);
+        printf ("\n");
+        usage(-2);
+    }
+
+    // A file mapping uses the page cache, which can not be backed by huge pages
+    if (opt->mmap_file != NULL && opt->hugepages) {
+        printf("--mmap can not be used with --hugepages\n");
+        usage(-3);
+    }
+
+    return 0;
+}
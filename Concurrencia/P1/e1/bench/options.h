@@ -0,0 +1,50 @@
+#ifndef __OPTIONS_H__
+#define __OPTIONS_H__
+
+#include "locks.h"
+
+/*
+ * options.c y options.h:
+ * Gestionan la entrada de parámetros de línea de comandos del benchmark:
+ * listas de hilos y estrategias a medir, tamaño del buffer, iteraciones, etc.
+ */
+
+#define MAX_THREAD_COUNTS 32
+
+// How the swap threads get their positions
+enum acquire_mode {
+	ACQUIRE_BLOCKING,  // wait on the locks, in order
+	ACQUIRE_RETRY,     // trylock; on failure back off and try the same positions again
+	ACQUIRE_REPICK,    // trylock; on failure back off and pick new positions
+};
+
+#define MAX_LOCK_STRIPES (1 << 30)   // Largest power of two an int can hold
+
+struct options {
+	int thread_counts[MAX_THREAD_COUNTS];  // number of threads of each run
+	int num_thread_counts;
+	int strategies[NUM_LOCK_STRATEGIES];   // enum lock_strategy of each run
+	int num_strategies;
+	long buffer_size;
+	long iterations;     // total swaps of each run, shared by all its threads
+	char *mmap_file;     // file that backs the buffer (NULL: anonymous memory)
+	int hugepages;       // back the buffer with huge pages
+	int delay;
+	int work_ns;         // busy work inside the critical section (in ns)
+	int think_ns;        // busy work between swaps (in ns)
+	int batch;           // swaps applied under a single lock_set()
+	int acquire;         // enum acquire_mode
+	char *thread_stats;  // file for the statistics of each thread (NULL: not written)
+	int lock_stripes;    // size of the striped lock table (rounded up to a power of two)
+	char *distribution;  // distribution of the positions (see dist.h)
+	char *counts_file;   // file for the accesses to each position (NULL: not counted)
+	char *pin;           // thread placement: none, compact, scatter or a CPU list
+	unsigned long seed;  // seed of the per-thread position generators
+	int verify;          // check that the buffer is still a permutation after each run
+	int header;          // print the CSV header
+};
+
+int read_options(int argc, char **argv, struct options *opt);
+
+
+#endif
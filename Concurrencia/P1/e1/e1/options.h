@@ -13,6 +13,12 @@ struct options {
 	int iterations;
 	int delay;
 	int print_wait;
+	unsigned long seed;   // seed of the per-thread position generators
+	int trace;           // enum trace_mode
+	char *trace_file;    // trace output (NULL: default for the mode)
+	int verify;          // check that the final buffer is a permutation instead of printing it
+	char *distribution;  // distribution of the positions (see dist.h)
+	char *counts_file;   // file for the accesses to each position (NULL: not counted)
 };
 
 int read_options(int argc, char **argv, struct options *opt);
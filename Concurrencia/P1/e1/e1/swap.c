@@ -10,15 +10,23 @@
 #include <errno.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
+#include "dist.h"
 #include "op_count.h"
 #include "options.h"
+#include "rng.h"
+#include "trace.h"
+#include "verify.h"
 
 struct buffer {
     int *data;      //Pointer to the buffer (an integer array)
     int size;       //The size (number of elements) of the buffer
     pthread_mutex_t bufferMutex;    //Mutex to protect the array accesses
+    struct dist dist;                    // Distribution of the swapped positions
+    uint32_t *counts;                    // Accesses to each position, updated while holding it (NULL: not counted)
 };
 
 struct thread_info {
@@ -30,27 +38,37 @@ struct args {
     int				thread_num;       // application defined thread #
     int				delay;			  // delay between operations (in microseconds) to force context switches
     int				iterations;       //
+    unsigned long	seed;             // seed of the position generator
     struct buffer	*buffer;		  // Pointer to the Shared buffer
 };
 
+// Trace events logged by the swap threads
+enum { EV_SWAP, NUM_EVENTS };
+
+static const char *trace_events[NUM_EVENTS] = {
+    [EV_SWAP] = "Thread %d swapping positions %d (== %d) and %d (== %d)\n",
+};
+
 //Swap function executed by each thread
 void *swap(void *ptr)
 {
     struct args *args =  ptr;   //Cast the argument to our args structure
+    struct rng rng;    // Private generator, so threads do not contend on rand()'s lock
+
+    rng_seed(&rng, args->seed, args->thread_num);
 
     //Each thread performs 'iterations' swaps
     while(args->iterations--) {
         int i,j, tmp;
 
         //Choose two random indexes within the buffer range
-        i=rand() % args->buffer->size;
-        j=rand() % args->buffer->size;
+        i=dist_sample(&args->buffer->dist, &rng);
+        j=dist_sample(&args->buffer->dist, &rng);
 
         pthread_mutex_lock(&args->buffer->bufferMutex); //Lock the mutex to ensure exclusive access to the buffer while swapping
 
-        //Print swap details
-        printf("Thread %d swapping positions %d (== %d) and %d (== %d)\n",
-            args->thread_num, i, args->buffer->data[i], j, args->buffer->data[j]);
+        //Log swap details
+        TRACE(args->thread_num, EV_SWAP, args->thread_num, i, args->buffer->data[i], j, args->buffer->data[j]);
 
         //Swap the values at positions i and j
         tmp = args->buffer->data[i];
@@ -64,6 +82,10 @@ void *swap(void *ptr)
 
         //Increment the global operation counter
         inc_count();
+        if (args->buffer->counts != NULL) {
+            args->buffer->counts[i]++;
+            args->buffer->counts[j]++;
+        }
 
         pthread_mutex_unlock(&args->buffer->bufferMutex); //Unlock the mutex so that the other threads can access the buffer
     }
@@ -86,6 +108,23 @@ void print_buffer(struct buffer buffer) {
     printf("\n");
 }
 
+// Write how many times each accessed position was swapped
+static void write_counts(const char *file, const uint32_t *counts, int size)
+{
+    FILE *f = fopen(file, "w");
+
+    if (f == NULL) {
+        printf("Could not create %s\n", file);
+        exit(1);
+    }
+    fprintf(f, "position,accesses\n");
+    for (int k = 0; k < size; k++) {
+        if (counts[k] > 0)
+            fprintf(f, "%d,%u\n", k, counts[k]);
+    }
+    fclose(f);
+}
+
 /*
  * This function initializes a shared buffer with sequential integers, creates a specified number
  * of swap threads that perform random swaps on the buffer, waits for all threads to finish,
@@ -100,7 +139,7 @@ void start_threads(struct options opt)
     struct args *args;              //Pointer to an array of arg structures
     struct buffer buffer;           //Local variable that holds the shared data array and its size
 
-    srand(time(NULL));
+    printf("seed: %lu\n", opt.seed);    // Print the seed so the run can be repeated
 
     //Allocate memory for the buffer's data array
     if((buffer.data=malloc(opt.buffer_size*sizeof(int)))==NULL) {
@@ -109,6 +148,17 @@ void start_threads(struct options opt)
     }
     buffer.size = opt.buffer_size;  //Set the buffer size
 
+    // Distribution of the swapped positions, and the access counters when asked for
+    if (dist_init(&buffer.dist, opt.distribution, buffer.size) != 0) {
+        printf("'%s': is not a valid distribution\n", opt.distribution);
+        exit(1);
+    }
+    buffer.counts = NULL;
+    if (opt.counts_file != NULL && (buffer.counts = calloc(buffer.size, sizeof(uint32_t))) == NULL) {
+        printf("Out of memory for the access counts\n");
+        exit(1);
+    }
+
     //Initialize the buffer with sequential values
     for(i=0; i<buffer.size; i++)
         buffer.data[i]=i;
@@ -130,8 +180,16 @@ void start_threads(struct options opt)
         exit(1);
     }
 
-    printf("Buffer before: ");
-    print_buffer(buffer);
+    if (!opt.verify) {
+        printf("Buffer before: ");
+        print_buffer(buffer);
+    }
+
+    // Start the trace flusher, with one ring per swap thread
+    if (trace_init(opt.trace, opt.trace_file, opt.num_threads, trace_events, NUM_EVENTS) != 0) {
+        printf("Could not start the trace log\n");
+        exit(1);
+    }
 
 
     // Create num_thread threads running swap()
@@ -142,6 +200,7 @@ void start_threads(struct options opt)
         args[i].thread_num = i;
         args[i].buffer     = &buffer;
         args[i].delay      = opt.delay;
+        args[i].seed       = opt.seed;
         args[i].iterations = opt.iterations;    //Number of swaps each thread should perfom
 
         //Create the thread that will execute the swap function
@@ -156,13 +215,29 @@ void start_threads(struct options opt)
     for (i = 0; i < opt.num_threads; i++)
         pthread_join(threads[i].thread_id, NULL);
 
-    printf("Buffer after:  ");
-    qsort(buffer.data, opt.buffer_size, sizeof(int), (int (*)(const void *, const void *)) cmp);
-    print_buffer(buffer);
+    // Write out the pending trace records
+    trace_finish();
+
+    if (opt.verify) {
+        long bad = verify_permutation(buffer.data, sizeof(int), opt.buffer_size, opt.num_threads);
+        if (bad < 0)
+            printf("verify: PASS\n");
+        else
+            printf("verify: FAIL (position %ld holds %d)\n", bad, buffer.data[bad]);
+    } else {
+        printf("Buffer after:  ");
+        qsort(buffer.data, opt.buffer_size, sizeof(int), (int (*)(const void *, const void *)) cmp);
+        print_buffer(buffer);
+    }
 
     // Print the total number of swap operations performed.
     printf("iterations: %d\n", get_count());
 
+    if (buffer.counts != NULL) {
+        write_counts(opt.counts_file, buffer.counts, buffer.size);
+        free(buffer.counts);
+    }
+
     free(args);
     free(threads);
     free(buffer.data);
@@ -181,6 +256,12 @@ int main (int argc, char **argv)
     opt.buffer_size = 10;
     opt.iterations  = 100;
     opt.delay       = 10;
+    opt.seed        = time(NULL);
+    opt.trace       = TRACE_TEXT;
+    opt.trace_file  = NULL;
+    opt.verify      = 0;
+    opt.distribution = "uniform";
+    opt.counts_file  = NULL;
 
     read_options(argc, argv, &opt);
 
@@ -7,12 +7,21 @@
  * el número de hilos, tamaño del buffer, iteraciones, retraso, etc.
  */
 
+#define MAX_LOCK_STRIPES (1 << 30)   // Largest power of two an int can hold
+
 struct options {
 	int num_threads;
 	int buffer_size;
 	int iterations;
 	int delay;
 	int print_wait;
+	int lock_stripes; // 0: one mutex per position, otherwise size of the striped lock table
+	unsigned long seed;   // seed of the per-thread position generators
+	int trace;           // enum trace_mode
+	char *trace_file;    // trace output (NULL: default for the mode)
+	int verify;          // check that the final buffer is a permutation instead of printing it
+	char *distribution;  // distribution of the positions (see dist.h)
+	char *counts_file;   // file for the accesses to each position (NULL: not counted)
 };
 
 int read_options(int argc, char **argv, struct options *opt);
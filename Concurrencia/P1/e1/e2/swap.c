@@ -8,11 +8,19 @@
  */
 #include <errno.h>
 #include <pthread.h>
+#include <stdalign.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
+#include "lock_prof.h"
+#include "dist.h"
 #include "op_count.h"
 #include "options.h"
+#include "rng.h"
+#include "trace.h"
+#include "verify.h"
 
 /*
 * swap.c:
@@ -24,11 +32,23 @@
     El programa usa pthread para la concurrencia y getopt_long para procesar argumentos de línea de comandos.
  */
 
+#define CACHE_LINE_SIZE 64
+
+// Mutex padded to a whole cache line, so two stripes never share one
+struct lock_stripe {
+    alignas(CACHE_LINE_SIZE) pthread_mutex_t m;
+};
+
 // Structure representing a shared buffer
 struct buffer {
     int *data;    //array of integers
     int size;     //size of the buffer
-    pthread_mutex_t *positionsMutexs;    //Array of mutexes, one mutex for each buffer position
+    pthread_mutex_t *positionsMutexs;    //Array of mutexes, one mutex for each buffer position (NULL when striped)
+    struct lock_stripe *stripes;         //Striped lock table shared by all positions (NULL when not striped)
+    int numLocks;                        //Number of locks: size, or the number of stripes
+    struct lock_prof *lockProf;          //LOCK_PROFILE: statistics of each position lock or stripe
+    struct dist dist;                    // Distribution of the swapped positions
+    uint32_t *counts;                    // Accesses to each position, updated while holding it (NULL: not counted)
 };
 
 struct thread_info {
@@ -40,35 +60,64 @@ struct args {
     int				thread_num;       // application defined thread #
     int				delay;			  // delay between operations
     int				iterations;       // number of iterations
+    unsigned long	seed;             // seed of the position generator
     struct buffer	*buffer;		  // Shared buffer
 };
 
+// Trace events logged by the swap threads
+enum { EV_SWAP, NUM_EVENTS };
+
+static const char *trace_events[NUM_EVENTS] = {
+    [EV_SWAP] = "Thread %d swapping positions %d (== %d) and %d (== %d)\n",
+};
+
+// Index of the lock that protects position pos. Stripes are a power of two, so pos is hashed with a mask
+static int lock_index(struct buffer *buffer, int pos)
+{
+    if (buffer->stripes == NULL)
+        return pos;
+    return pos & (buffer->numLocks - 1);
+}
+
+// Lock with the given index
+static pthread_mutex_t *lock_at(struct buffer *buffer, int idx)
+{
+    if (buffer->stripes == NULL)
+        return &buffer->positionsMutexs[idx];
+    return &buffer->stripes[idx].m;
+}
+
 // Function executed by each thread, swapping elements in the shared buffer
 void *swap(void *ptr)
 {
     struct args *args =  ptr;
+    struct rng rng;    // Private generator, so threads do not contend on rand()'s lock
+
+    rng_seed(&rng, args->seed, args->thread_num);
 
     while(args->iterations--) {
         int i,j, tmp;
+        int li, lj;    //Indexes of the locks protecting i and j
 
-        i=rand() % args->buffer->size;
-        j=rand() % args->buffer->size;
+        i=dist_sample(&args->buffer->dist, &rng);
+        j=dist_sample(&args->buffer->dist, &rng);
+        li = lock_index(args->buffer, i);
+        lj = lock_index(args->buffer, j);
 
         //Avoid deadlock by acquiring resources in a consistent order, thus, we will avoid a circular wait between threads
-        if (i != j) {
-            if (i < j) {
-                pthread_mutex_lock(&args->buffer->positionsMutexs[i]);
-                pthread_mutex_lock(&args->buffer->positionsMutexs[j]);
+        if (li != lj) {
+            if (li < lj) {
+                prof_lock(lock_at(args->buffer, li), &args->buffer->lockProf[li]);
+                prof_lock(lock_at(args->buffer, lj), &args->buffer->lockProf[lj]);
             } else {
-                pthread_mutex_lock(&args->buffer->positionsMutexs[j]);
-                pthread_mutex_lock(&args->buffer->positionsMutexs[i]);
+                prof_lock(lock_at(args->buffer, lj), &args->buffer->lockProf[lj]);
+                prof_lock(lock_at(args->buffer, li), &args->buffer->lockProf[li]);
             }
         } else {
-            pthread_mutex_lock(&args->buffer->positionsMutexs[i]); // Bloquear solo una vez si i == j
+            prof_lock(lock_at(args->buffer, li), &args->buffer->lockProf[li]); // Bloquear solo una vez si i y j comparten lock
         }
 
-        printf("Thread %d swapping positions %d (== %d) and %d (== %d)\n",
-            args->thread_num, i, args->buffer->data[i], j, args->buffer->data[j]);
+        TRACE(args->thread_num, EV_SWAP, args->thread_num, i, args->buffer->data[i], j, args->buffer->data[j]);
 
         tmp = args->buffer->data[i];
         if(args->delay) usleep(args->delay); // Force a context switch
@@ -79,10 +128,14 @@ void *swap(void *ptr)
         args->buffer->data[j] = tmp;
         if(args->delay) usleep(args->delay);
         inc_count();
+        if (args->buffer->counts != NULL) {
+            args->buffer->counts[i]++;
+            args->buffer->counts[j]++;
+        }
 
-        pthread_mutex_unlock(&args->buffer->positionsMutexs[i]);
-        if (i != j) {
-            pthread_mutex_unlock(&args->buffer->positionsMutexs[j]);
+        prof_unlock(lock_at(args->buffer, li), &args->buffer->lockProf[li]);
+        if (li != lj) {
+            prof_unlock(lock_at(args->buffer, lj), &args->buffer->lockProf[lj]);
         }
     }
     return NULL;
@@ -102,6 +155,93 @@ void print_buffer(struct buffer buffer) {
     printf("\n");
 }
 
+// Allocate and initialize the position locks: one per position, or a table of stripes (rounded up to a power of two)
+void init_locks(struct buffer *buffer, int stripes)
+{
+    int i;
+
+    buffer->positionsMutexs = NULL;
+    buffer->stripes = NULL;
+    buffer->lockProf = NULL;
+
+    if (stripes == 0) {
+        buffer->numLocks = buffer->size;
+        buffer->positionsMutexs = malloc(buffer->numLocks * sizeof(pthread_mutex_t));
+        if (buffer->positionsMutexs == NULL) {
+            printf("Out of memory for positions mutexes\n");
+            exit(1);
+        }
+    } else {
+        buffer->numLocks = 1;
+        while (buffer->numLocks < stripes)
+            buffer->numLocks <<= 1;
+        buffer->stripes = aligned_alloc(CACHE_LINE_SIZE, buffer->numLocks * sizeof(struct lock_stripe));
+        if (buffer->stripes == NULL) {
+            printf("Out of memory for lock stripes\n");
+            exit(1);
+        }
+        printf("using %d lock stripes\n", buffer->numLocks);
+    }
+
+    for (i = 0; i < buffer->numLocks; i++) {
+        if (pthread_mutex_init(lock_at(buffer, i), NULL) != 0) {
+            printf("Error initializing mutex %d\n", i);
+            exit(1);
+        }
+    }
+#ifdef LOCK_PROFILE
+    buffer->lockProf = lock_prof_alloc(buffer->stripes != NULL ? "stripe" : "position", buffer->numLocks);
+#endif
+}
+
+// Destroy the position locks and free their memory
+void destroy_locks(struct buffer *buffer)
+{
+    int i;
+
+    for (i = 0; i < buffer->numLocks; i++) {
+        pthread_mutex_destroy(lock_at(buffer, i));
+    }
+    free(buffer->positionsMutexs);
+    free(buffer->stripes);
+    free(buffer->lockProf);
+}
+
+#ifdef LOCK_PROFILE
+// Print the most contended of the position locks
+static void report_locks(struct buffer *buffer)
+{
+    struct lock_prof **profs = malloc(buffer->numLocks * sizeof(struct lock_prof *));
+
+    if (profs == NULL) {
+        printf("Out of memory for the lock profile\n");
+        exit(1);
+    }
+    for (int i = 0; i < buffer->numLocks; i++)
+        profs[i] = &buffer->lockProf[i];
+
+    lock_prof_report(profs, buffer->numLocks);
+    free(profs);
+}
+#endif
+
+// Write how many times each accessed position was swapped
+static void write_counts(const char *file, const uint32_t *counts, int size)
+{
+    FILE *f = fopen(file, "w");
+
+    if (f == NULL) {
+        printf("Could not create %s\n", file);
+        exit(1);
+    }
+    fprintf(f, "position,accesses\n");
+    for (int k = 0; k < size; k++) {
+        if (counts[k] > 0)
+            fprintf(f, "%d,%u\n", k, counts[k]);
+    }
+    fclose(f);
+}
+
 // Function to initialize and start threads
 void start_threads(struct options opt)
 {
@@ -110,7 +250,7 @@ void start_threads(struct options opt)
     struct args *args;              //Pointer to an array of arg structures
     struct buffer buffer;           //Local variable that holds the shared data array and its size
 
-    srand(time(NULL));    // Seed random number generator
+    printf("seed: %lu\n", opt.seed);    // Print the seed so the run can be repeated
 
     if((buffer.data=malloc(opt.buffer_size*sizeof(int)))==NULL) {
         printf("Out of memory\n");
@@ -118,22 +258,25 @@ void start_threads(struct options opt)
     }
     buffer.size = opt.buffer_size;
 
-    // Allocate a mutex for each buffer position
-    buffer.positionsMutexs = malloc(buffer.size * sizeof(pthread_mutex_t));
-    if (buffer.positionsMutexs == NULL) {
-        printf("Out of memory for positions mutexes\n");
-        free(buffer.data);
+    // Distribution of the swapped positions, and the access counters when asked for
+    if (dist_init(&buffer.dist, opt.distribution, buffer.size) != 0) {
+        printf("'%s': is not a valid distribution\n", opt.distribution);
         exit(1);
     }
-    // Initialize buffer data and mutexes
+    buffer.counts = NULL;
+    if (opt.counts_file != NULL && (buffer.counts = calloc(buffer.size, sizeof(uint32_t))) == NULL) {
+        printf("Out of memory for the access counts\n");
+        exit(1);
+    }
+
+    // Initialize buffer data
     for (i = 0; i < buffer.size; i++) {
         buffer.data[i]=i;
-        if (pthread_mutex_init(&buffer.positionsMutexs[i], NULL) != 0) {
-            printf("Error initializing mutex for position %d\n", i);
-            exit(1);
-        }
     }
 
+    // Allocate a mutex for each buffer position, or the striped lock table
+    init_locks(&buffer, opt.lock_stripes);
+
     printf("creating %d threads\n", opt.num_threads);
 
     // Allocate memory for the info structure of each thread and its respective arguments structure
@@ -145,8 +288,16 @@ void start_threads(struct options opt)
         exit(1);
     }
 
-    printf("Buffer before: ");
-    print_buffer(buffer);
+    if (!opt.verify) {
+        printf("Buffer before: ");
+        print_buffer(buffer);
+    }
+
+    // Start the trace flusher, with one ring per swap thread
+    if (trace_init(opt.trace, opt.trace_file, opt.num_threads, trace_events, NUM_EVENTS) != 0) {
+        printf("Could not start the trace log\n");
+        exit(1);
+    }
 
 
     // Create num_thread threads running swap()
@@ -156,6 +307,7 @@ void start_threads(struct options opt)
         args[i].thread_num = i;
         args[i].buffer     = &buffer;
         args[i].delay      = opt.delay;
+        args[i].seed       = opt.seed;
         args[i].iterations = opt.iterations;
 
         if (pthread_create(&threads[i].thread_id, NULL, swap, &args[i]) != 0) {
@@ -168,18 +320,35 @@ void start_threads(struct options opt)
     for (i = 0; i < opt.num_threads; i++)
         pthread_join(threads[i].thread_id, NULL);
 
+    // Write out the pending trace records
+    trace_finish();
+
     // Print sorted buffer after operations
-    printf("Buffer after:  ");
-    qsort(buffer.data, opt.buffer_size, sizeof(int), (int (*)(const void *, const void *)) cmp);
-    print_buffer(buffer);
+    if (opt.verify) {
+        long bad = verify_permutation(buffer.data, sizeof(int), opt.buffer_size, opt.num_threads);
+        if (bad < 0)
+            printf("verify: PASS\n");
+        else
+            printf("verify: FAIL (position %ld holds %d)\n", bad, buffer.data[bad]);
+    } else {
+        printf("Buffer after:  ");
+        qsort(buffer.data, opt.buffer_size, sizeof(int), (int (*)(const void *, const void *)) cmp);
+        print_buffer(buffer);
+    }
 
     printf("iterations: %d\n", get_count());
 
-    // Destroy mutexes and free memory
-    for (i = 0; i < buffer.size; i++) {
-        pthread_mutex_destroy(&buffer.positionsMutexs[i]);
+    if (buffer.counts != NULL) {
+        write_counts(opt.counts_file, buffer.counts, buffer.size);
+        free(buffer.counts);
     }
-    free(buffer.positionsMutexs);
+
+#ifdef LOCK_PROFILE
+    report_locks(&buffer);
+#endif
+
+    // Destroy mutexes and free memory
+    destroy_locks(&buffer);
     free(args);
     free(threads);
     free(buffer.data);
@@ -196,6 +365,13 @@ int main (int argc, char **argv)
     opt.buffer_size = 10;
     opt.iterations  = 10;
     opt.delay       = 10;
+    opt.seed        = time(NULL);
+    opt.trace       = TRACE_TEXT;
+    opt.trace_file  = NULL;
+    opt.verify      = 0;
+    opt.distribution = "uniform";
+    opt.counts_file  = NULL;
+    opt.lock_stripes = 0;
 
     // Read options from command line arguments
     read_options(argc, argv, &opt);
@@ -3,8 +3,8 @@
 
 /*
  * op_count.c y op_count.h:
- * Manejan una variable global count protegida por un mutex
- * para contar las operaciones realizadas por los hilos.
+ * Cuentan las operaciones realizadas por los hilos con un contador
+ * repartido en un slot por hilo, que se incrementa sin mutex.
  */
 
 void inc_count();
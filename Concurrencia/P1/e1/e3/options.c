@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "options.h"
+#include "trace.h"
 
 static struct option long_options[] = {
     { .name = "threads",
@@ -25,6 +26,42 @@ static struct option long_options[] = {
       .has_arg = required_argument,
       .flag = NULL,
       .val = 'p'},
+    { .name = "print_sample",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'n'},
+    { .name = "lock-stripes",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 's'},
+    { .name = "strategy",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'S'},
+    { .name = "seed",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'r'},
+    { .name = "trace",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'T'},
+    { .name = "trace_file",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'o'},
+    { .name = "distribution",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'D'},
+    { .name = "counts",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'c'},
+    { .name = "verify",
+      .has_arg = no_argument,
+      .flag = NULL,
+      .val = 'v'},
     { .name = "help",
       .has_arg = no_argument,
       .flag = NULL,
@@ -42,6 +79,18 @@ static void usage(int i)
         "  -i n, --iterations=<n>: total number of iterations\n"
         "  -d n, --delay=<n>: delay between buffer ops (us)\n"
         "  -p n, --print_wait=<n>: delay between prints of the array\n"
+        "  -n n, --print_sample=<n>: print only n evenly spaced positions of the array\n"
+        "  -s n, --lock-stripes=<n>: share a table of n cache-line aligned locks\n"
+        "                            between positions (rounded up to a power of two)\n"
+        "  -S s, --strategy=<s>: mutex (default) or lockfree\n"
+        "  -r n, --seed=<n>: seed for the position generators (default: current time)\n"
+        "  -T m, --trace=<m>: trace log: off, text (default) or binary\n"
+        "  -o f, --trace_file=<f>: trace output (default: stdout, or trace.bin when binary)\n"
+        "  -D d, --distribution=<d>: positions picked: uniform (default), zipf:θ (0 < θ < 1)\n"
+        "                            or hotspot:f[:p] (fraction p of the accesses to the first\n"
+        "                            f of the buffer, p = 0.8 by default)\n"
+        "  -c f, --counts=<f>: count the accesses to each position and write them to f\n"
+        "  -v, --verify: check that the final buffer is a permutation, instead of printing it sorted\n"
         "  -h, --help: this message\n\n"
     );
     exit(i);
@@ -55,6 +104,14 @@ static int get_int(char *arg, int *value)
     return (end != NULL);
 }
 
+static int get_ulong(char *arg, unsigned long *value)
+{
+    char *end;
+    *value = strtoul(arg, &end, 10);
+
+    return (end != arg && *end == '\0');
+}
+
 /*
  * Uso de getopt_long en options.c:
     Se manejan diferentes opciones con nombres largos y cortos.
@@ -67,7 +124,7 @@ int handle_options(int argc, char **argv, struct options *opt)
         int c;
         int option_index = 0;
 
-        c = getopt_long (argc, argv, "ht:b:i:d:p:",
+        c = getopt_long (argc, argv, "hvD:c:t:b:i:d:p:n:s:S:r:T:o:",
                  long_options, &option_index);
         if (c == -1)
             break;
@@ -102,7 +159,7 @@ int handle_options(int argc, char **argv, struct options *opt)
 
         case 'd':
             if (!get_int(optarg, &opt->delay)
-                || opt->delay <= 0) {
+                || opt->delay < 0) {
                 printf("'%s': is not a valid integer\n",
                        optarg);
                 usage(-3);
@@ -118,6 +175,73 @@ int handle_options(int argc, char **argv, struct options *opt)
             }
             break;
 
+        case 'n':
+            if (!get_int(optarg, &opt->print_sample)
+                || opt->print_sample <= 0) {
+                printf("'%s': is not a valid integer\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 's':
+            if (!get_int(optarg, &opt->lock_stripes)
+                || opt->lock_stripes <= 0) {
+                printf("'%s': is not a valid integer\n",
+                       optarg);
+                usage(-3);
+            }
+            // The table is rounded up to a power of two, which must still fit in an int
+            if (opt->lock_stripes > MAX_LOCK_STRIPES) {
+                printf("'%s': too many lock stripes (at most %d)\n",
+                       optarg, MAX_LOCK_STRIPES);
+                usage(-3);
+            }
+            break;
+
+        case 'S':
+            if (strcmp(optarg, "mutex") == 0) {
+                opt->strategy = STRATEGY_MUTEX;
+            } else if (strcmp(optarg, "lockfree") == 0) {
+                opt->strategy = STRATEGY_LOCKFREE;
+            } else {
+                printf("'%s': is not a valid strategy\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'r':
+            if (!get_ulong(optarg, &opt->seed)) {
+                printf("'%s': is not a valid integer\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'T':
+            if ((opt->trace = trace_parse_mode(optarg)) < 0) {
+                printf("'%s': is not a valid trace mode\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'o':
+            opt->trace_file = optarg;
+            break;
+
+        case 'v':
+            opt->verify = 1;
+            break;
+
+        case 'D':
+            opt->distribution = optarg;
+            break;
+
+        case 'c':
+            opt->counts_file = optarg;
+            break;
 
         case '?':
         case 'h':
@@ -147,5 +271,9 @@ int read_options(int argc, char **argv, struct options *opt) {
         usage(-2);
     }
 
+    // More stripes than positions would never be used
+    if (opt->lock_stripes > opt->buffer_size)
+        opt->lock_stripes = opt->buffer_size;
+
     return 0;
 }
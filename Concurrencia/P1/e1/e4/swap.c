@@ -9,12 +9,22 @@
 
 #include <errno.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdalign.h>
+#include <stdatomic.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include "lock_prof.h"
+#include "dist.h"
 #include "op_count.h"
 #include "options.h"
+#include "rng.h"
+#include "trace.h"
+#include "verify.h"
 
 /*
 * swap.c:
@@ -26,14 +36,40 @@
     The program uses pthread for concurrency and getopt_long to process command line arguments.
  */
 
+#define CACHE_LINE_SIZE 64
+#define MAX_BACKOFF_SPINS 1024
+#define SNAPSHOT_RETRIES 100   // Attempts of the printer to get a consistent copy of the buffer
+#define ITER_BATCH 64          // Iterations claimed from globalIter at a time by each thread
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() atomic_signal_fence(memory_order_seq_cst)
+#endif
+
+// Mutex padded to a whole cache line, so two stripes never share one
+struct lock_stripe {
+    alignas(CACHE_LINE_SIZE) pthread_mutex_t m;
+};
+
 // Structure representing a shared buffer
 struct buffer {
     int *data;  // array of integers
     int size;  // size of the buffer
-    pthread_mutex_t *positionsMutexs;    // Array of mutexes, one for each position
-    pthread_mutex_t iterMutex;           // Mutex for iteration control
-    int globalIter;                      // Global iteration counter
+    pthread_mutex_t *positionsMutexs;    // Array of mutexes, one for each position (NULL when striped)
+    struct lock_stripe *stripes;         // Striped lock table shared by all positions (NULL when not striped)
+    int numLocks;                        // Number of locks: size, or the number of stripes
+    int strategy;                        // STRATEGY_MUTEX or STRATEGY_LOCKFREE
+    atomic_uint *slotOwners;             // Lock-free strategy: ownership/version word per position, odd while owned
+    atomic_int *published;               // Copy of data updated at the end of each swap, read by the printer
+    atomic_uint *publishedVersions;      // Version of each published position, odd while it is being updated
+    pthread_mutex_t iterMutex;           // Mutex for iteration control (protects stopIter)
+    struct lock_prof *lockProf;          // LOCK_PROFILE: statistics of each position lock (NULL when lock-free)
+    struct lock_prof *iterProf;          // LOCK_PROFILE: statistics of iterMutex
+    atomic_int globalIter;               // Global iteration counter, claimed in batches of ITER_BATCH
     bool stopIter;                       // Flag to stop iterations
+    struct dist dist;                    // Distribution of the swapped positions
+    uint32_t *counts;                    // Accesses to each position, updated while holding it (NULL: not counted)
 };
 
 // Structure representing thread information
@@ -46,50 +82,204 @@ struct thread_info {
 struct args {
     int				thread_num;       // application defined thread #
     int				delay;			  // delay between operations
+    unsigned long	seed;             // seed of the position generator
+    int				print_sample;     // printer: number of positions to print (0: all of them)
     struct buffer	*buffer;		  // Shared buffer
 };
 
+// Trace events logged by the swap threads
+enum { EV_SWAP, NUM_EVENTS };
+
+static const char *trace_events[NUM_EVENTS] = {
+    [EV_SWAP] = "Thread %d swapping positions %d (== %d) and %d (== %d)\n",
+};
+
+// Index of the lock that protects position pos. Stripes are a power of two, so pos is hashed with a mask
+static int lock_index(struct buffer *buffer, int pos)
+{
+    if (buffer->stripes == NULL)
+        return pos;
+    return pos & (buffer->numLocks - 1);
+}
+
+// Lock with the given index
+static pthread_mutex_t *lock_at(struct buffer *buffer, int idx)
+{
+    if (buffer->stripes == NULL)
+        return &buffer->positionsMutexs[idx];
+    return &buffer->stripes[idx].m;
+}
+
+// Spin for a while after a failed claim, doubling the wait each time. Once the limit is reached, yield the CPU
+static void backoff(unsigned *spins)
+{
+    unsigned k;
+
+    if (*spins >= MAX_BACKOFF_SPINS) {
+        sched_yield();
+        return;
+    }
+    for (k = 0; k < *spins; k++)
+        cpu_relax();
+    *spins <<= 1;
+}
+
+// Try to take ownership of position pos. Free positions hold an even version, owned ones an odd version
+static bool claim_slot(struct buffer *buffer, int pos)
+{
+    unsigned v = atomic_load_explicit(&buffer->slotOwners[pos], memory_order_relaxed);
+
+    return (v & 1) == 0
+        && atomic_compare_exchange_strong_explicit(&buffer->slotOwners[pos], &v, v + 1,
+                                                   memory_order_acquire, memory_order_relaxed);
+}
+
+// Give position pos back, moving its version to the next even value
+static void release_slot(struct buffer *buffer, int pos)
+{
+    atomic_fetch_add_explicit(&buffer->slotOwners[pos], 1, memory_order_release);
+}
+
+// Claim positions i and j in address order. If the second one is taken, drop the first and back off
+static void claim_pair(struct buffer *buffer, int i, int j)
+{
+    int lo = i < j ? i : j;
+    int hi = i < j ? j : i;
+    unsigned spins = 1;
+
+    while (1) {
+        if (claim_slot(buffer, lo)) {
+            if (lo == hi || claim_slot(buffer, hi))
+                return;
+            release_slot(buffer, lo);
+        }
+        backoff(&spins);
+    }
+}
+
+// Copy the new values of positions i and j to the published buffer. The caller owns both positions, so the
+// versions only stay odd for the two stores, and the printer never sees half of a swap
+static void publish_pair(struct buffer *buffer, int i, int j)
+{
+    atomic_fetch_add_explicit(&buffer->publishedVersions[i], 1, memory_order_relaxed);
+    if (i != j)
+        atomic_fetch_add_explicit(&buffer->publishedVersions[j], 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    atomic_store_explicit(&buffer->published[i], buffer->data[i], memory_order_relaxed);
+    atomic_store_explicit(&buffer->published[j], buffer->data[j], memory_order_relaxed);
+
+    atomic_fetch_add_explicit(&buffer->publishedVersions[i], 1, memory_order_release);
+    if (i != j)
+        atomic_fetch_add_explicit(&buffer->publishedVersions[j], 1, memory_order_release);
+}
+
+// Get exclusive access to positions i and j with the selected strategy
+static void lock_pair(struct buffer *buffer, int i, int j)
+{
+    int li, lj;    // Indexes of the locks protecting i and j
+
+    if (buffer->strategy == STRATEGY_LOCKFREE) {
+        claim_pair(buffer, i, j);
+        return;
+    }
+
+    li = lock_index(buffer, i);
+    lj = lock_index(buffer, j);
+
+    //Avoid deadlock by acquiring resources in a consistent order, thus, we will avoid a circular wait between threads
+    if (li != lj) {
+        if (li < lj) {
+            prof_lock(lock_at(buffer, li), &buffer->lockProf[li]);
+            prof_lock(lock_at(buffer, lj), &buffer->lockProf[lj]);
+        } else {
+            prof_lock(lock_at(buffer, lj), &buffer->lockProf[lj]);
+            prof_lock(lock_at(buffer, li), &buffer->lockProf[li]);
+        }
+    } else {
+        prof_lock(lock_at(buffer, li), &buffer->lockProf[li]); // Lock only once if i and j share a lock
+    }
+}
+
+// Publish and release positions i and j
+static void unlock_pair(struct buffer *buffer, int i, int j)
+{
+    int li, lj;
+
+    publish_pair(buffer, i, j);
+
+    if (buffer->strategy == STRATEGY_LOCKFREE) {
+        release_slot(buffer, i);
+        if (i != j)
+            release_slot(buffer, j);
+        return;
+    }
+
+    li = lock_index(buffer, i);
+    lj = lock_index(buffer, j);
+    prof_unlock(lock_at(buffer, li), &buffer->lockProf[li]);
+    if (li != lj) {
+        prof_unlock(lock_at(buffer, lj), &buffer->lockProf[lj]);
+    }
+}
+
+// Copy the published positions pos[0..n) into out without blocking the swap threads. The versions are read
+// before and after copying: if every position had the same even version both times, no swap was published
+// on any of them in between, so the copy is a consistent state of the buffer. Returns false if it was not
+static bool snapshot(struct buffer *buffer, const int *pos, int n, int *out, unsigned *versions)
+{
+    for (int k = 0; k < n; k++) {
+        versions[k] = atomic_load_explicit(&buffer->publishedVersions[pos[k]], memory_order_acquire);
+        if (versions[k] & 1)
+            return false;
+    }
+    for (int k = 0; k < n; k++)
+        out[k] = atomic_load_explicit(&buffer->published[pos[k]], memory_order_relaxed);
+
+    atomic_thread_fence(memory_order_acquire);
+    for (int k = 0; k < n; k++) {
+        if (atomic_load_explicit(&buffer->publishedVersions[pos[k]], memory_order_relaxed) != versions[k])
+            return false;
+    }
+    return true;
+}
+
 void *swap(void *ptr)
 {
     struct args *args =  ptr;
+    struct rng rng;    // Private generator, so threads do not contend on rand()'s lock
+
+    rng_seed(&rng, args->seed, args->thread_num);
+    int claimed = 0;    // Iterations claimed by this thread and not done yet
 
     while(1) {
         int i,j, tmp;
 
-        // Lock access to global iteration counter
-        pthread_mutex_lock(&args->buffer->iterMutex);
-        if (args->buffer->globalIter <= 0) {
-            pthread_mutex_unlock(&args->buffer->iterMutex);
-            break; // Exit if no iterations left
-        }
-        args->buffer->globalIter--; // Decrement global iteration counter
+        // Claim a new batch of iterations from the global counter when the previous one is used up
+        if (claimed == 0) {
+            int left = atomic_fetch_sub(&args->buffer->globalIter, ITER_BATCH);
+            if (left <= 0) {
+                break; // Exit if no iterations left
+            }
+            claimed = left < ITER_BATCH ? left : ITER_BATCH;
 
-        // If counter reaches 0, signal the printer thread to stop
-        if (args->buffer->globalIter == 0) {
-            args->buffer->stopIter = true;
+            // If this batch takes the last iterations, signal the printer thread to stop
+            if (left <= ITER_BATCH) {
+                prof_lock(&args->buffer->iterMutex, args->buffer->iterProf);
+                args->buffer->stopIter = true;
+                prof_unlock(&args->buffer->iterMutex, args->buffer->iterProf);
+            }
         }
-        pthread_mutex_unlock(&args->buffer->iterMutex);
+        claimed--;
 
         // Randomly select two positions in the buffer
-        i=rand() % args->buffer->size;
-        j=rand() % args->buffer->size;
-
-        //Avoid deadlock by acquiring resources in a consistent order, thus, we will avoid a circular wait between threads
-        if (i != j) {
-            if (i < j) {
-                pthread_mutex_lock(&args->buffer->positionsMutexs[i]);
-                pthread_mutex_lock(&args->buffer->positionsMutexs[j]);
-            } else {
-                pthread_mutex_lock(&args->buffer->positionsMutexs[j]);
-                pthread_mutex_lock(&args->buffer->positionsMutexs[i]);
-            }
-        } else {
-            pthread_mutex_lock(&args->buffer->positionsMutexs[i]); // Bloquear solo una vez si i == j
-        }
+        i=dist_sample(&args->buffer->dist, &rng);
+        j=dist_sample(&args->buffer->dist, &rng);
+
+        lock_pair(args->buffer, i, j);
 
-        // Print the swap operation
-        printf("Thread %d swapping positions %d (== %d) and %d (== %d)\n",
-            args->thread_num, i, args->buffer->data[i], j, args->buffer->data[j]);
+        // Log the swap operation
+        TRACE(args->thread_num, EV_SWAP, args->thread_num, i, args->buffer->data[i], j, args->buffer->data[j]);
 
         // Swap the elements
         tmp = args->buffer->data[i];
@@ -101,13 +291,14 @@ void *swap(void *ptr)
         args->buffer->data[j] = tmp;
         if(args->delay) usleep(args->delay);
         inc_count();
-
-        // Unlock the mutexes
-        pthread_mutex_unlock(&args->buffer->positionsMutexs[i]);
-        if (i != j) {
-            pthread_mutex_unlock(&args->buffer->positionsMutexs[j]);
+        if (args->buffer->counts != NULL) {
+            args->buffer->counts[i]++;
+            args->buffer->counts[j]++;
         }
 
+        // Release both positions
+        unlock_pair(args->buffer, i, j);
+
     }
     return NULL;
 }
@@ -131,36 +322,181 @@ void print_buffer(struct buffer buffer) {
 // Function executed by the printer thread to periodically print the buffer
 void *print_periodic (void *ptr) {
     struct args *args = ptr;
+    int n = args->buffer->size;    // Positions printed
+    int stride = 1;                // Distance between printed positions
+    int *pos, *values;
+    unsigned *versions;
+
+    // With a sample size, print a bounded number of evenly spaced positions
+    if (args->print_sample > 0 && args->print_sample < n) {
+        stride = n / args->print_sample;
+        n = args->print_sample;
+    }
+    pos = malloc(n * sizeof(int));
+    values = malloc(n * sizeof(int));
+    versions = malloc(n * sizeof(unsigned));
+    if (pos == NULL || values == NULL || versions == NULL) {
+        printf("Out of memory for the printer\n");
+        exit(1);
+    }
+    for (int k = 0; k < n; k++)
+        pos[k] = k * stride;
 
     while (1){
         usleep(args->delay);
 
-        pthread_mutex_lock(&args->buffer->iterMutex);
+        prof_lock(&args->buffer->iterMutex, args->buffer->iterProf);
         if (args->buffer->stopIter) {  // Check if we should stop
-            pthread_mutex_unlock(&args->buffer->iterMutex);
+            prof_unlock(&args->buffer->iterMutex, args->buffer->iterProf);
             break;
         }
-        pthread_mutex_unlock(&args->buffer->iterMutex);
-
-        // Lock each position in the buffer
-        for (int i = 0; i < args->buffer->size; i++) {
-        	pthread_mutex_lock(&args->buffer->positionsMutexs[i]);
+        prof_unlock(&args->buffer->iterMutex, args->buffer->iterProf);
+
+        // Take a consistent copy without locking, retrying while a swap is being published
+        int tries = 0;
+        while (!snapshot(args->buffer, pos, n, values, versions) && ++tries < SNAPSHOT_RETRIES)
+            sched_yield();
+        if (tries == SNAPSHOT_RETRIES) {
+            printf("Buffer: busy, no consistent snapshot\n");
+            continue;
         }
+
         // Print the buffer content
-        printf("Buffer: ");
-        for (int i = 0; i < args->buffer->size; i++) {
-          	printf("%d ", args->buffer->data[i]);
-        }
-        // Unlock each position in the buffer
-        for (int i = 0; i < args->buffer->size; i++) {
-          	pthread_mutex_unlock(&args->buffer->positionsMutexs[i]);
+        if (stride > 1)
+            printf("Buffer (%d of %d positions, every %d): ", n, args->buffer->size, stride);
+        else
+            printf("Buffer: ");
+        for (int k = 0; k < n; k++) {
+            printf("%d ", values[k]);
         }
         printf("\n");
     }
 
+    free(pos);
+    free(values);
+    free(versions);
     return NULL;
 }
 
+// Allocate and initialize the position locks: one per position, or a table of stripes (rounded up to a power of two).
+// The lock-free strategy only needs an ownership word per position
+void init_locks(struct buffer *buffer, int strategy, int stripes)
+{
+    int i;
+
+    buffer->positionsMutexs = NULL;
+    buffer->stripes = NULL;
+    buffer->slotOwners = NULL;
+    buffer->lockProf = NULL;
+    buffer->strategy = strategy;
+
+    // Published copy of the data and its versions, which let the printer take snapshots without locking
+    buffer->published = malloc(buffer->size * sizeof(atomic_int));
+    buffer->publishedVersions = calloc(buffer->size, sizeof(atomic_uint));
+    if (buffer->published == NULL || buffer->publishedVersions == NULL) {
+        printf("Out of memory for the published buffer\n");
+        exit(1);
+    }
+    for (i = 0; i < buffer->size; i++)
+        atomic_init(&buffer->published[i], buffer->data[i]);
+
+    if (strategy == STRATEGY_LOCKFREE) {
+        buffer->numLocks = buffer->size;
+        buffer->slotOwners = calloc(buffer->numLocks, sizeof(atomic_uint));
+        if (buffer->slotOwners == NULL) {
+            printf("Out of memory for slot owners\n");
+            exit(1);
+        }
+        return;
+    }
+
+    if (stripes == 0) {
+        buffer->numLocks = buffer->size;
+        buffer->positionsMutexs = malloc(buffer->numLocks * sizeof(pthread_mutex_t));
+        if (buffer->positionsMutexs == NULL) {
+            printf("Out of memory for positions mutexes\n");
+            exit(1);
+        }
+    } else {
+        buffer->numLocks = 1;
+        while (buffer->numLocks < stripes)
+            buffer->numLocks <<= 1;
+        buffer->stripes = aligned_alloc(CACHE_LINE_SIZE, buffer->numLocks * sizeof(struct lock_stripe));
+        if (buffer->stripes == NULL) {
+            printf("Out of memory for lock stripes\n");
+            exit(1);
+        }
+        printf("using %d lock stripes\n", buffer->numLocks);
+    }
+
+    for (i = 0; i < buffer->numLocks; i++) {
+        if (pthread_mutex_init(lock_at(buffer, i), NULL) != 0) {
+            printf("Error initializing mutex %d\n", i);
+            exit(1);
+        }
+    }
+#ifdef LOCK_PROFILE
+    buffer->lockProf = lock_prof_alloc(buffer->stripes != NULL ? "stripe" : "position", buffer->numLocks);
+#endif
+}
+
+// Destroy the position locks and free their memory
+void destroy_locks(struct buffer *buffer)
+{
+    int i;
+
+    free(buffer->published);
+    free(buffer->publishedVersions);
+    free(buffer->lockProf);
+    if (buffer->strategy == STRATEGY_LOCKFREE) {
+        free(buffer->slotOwners);
+        return;
+    }
+
+    for (i = 0; i < buffer->numLocks; i++) {
+        pthread_mutex_destroy(lock_at(buffer, i));
+    }
+    free(buffer->positionsMutexs);
+    free(buffer->stripes);
+}
+
+#ifdef LOCK_PROFILE
+// Print the most contended of the position locks and iterMutex
+static void report_locks(struct buffer *buffer)
+{
+    long n = 0;
+    struct lock_prof **profs = malloc((buffer->numLocks + 1) * sizeof(struct lock_prof *));
+
+    if (profs == NULL) {
+        printf("Out of memory for the lock profile\n");
+        exit(1);
+    }
+    for (int i = 0; buffer->lockProf != NULL && i < buffer->numLocks; i++)
+        profs[n++] = &buffer->lockProf[i];
+    profs[n++] = buffer->iterProf;
+
+    lock_prof_report(profs, n);
+    free(profs);
+}
+#endif
+
+// Write how many times each accessed position was swapped
+static void write_counts(const char *file, const uint32_t *counts, int size)
+{
+    FILE *f = fopen(file, "w");
+
+    if (f == NULL) {
+        printf("Could not create %s\n", file);
+        exit(1);
+    }
+    fprintf(f, "position,accesses\n");
+    for (int k = 0; k < size; k++) {
+        if (counts[k] > 0)
+            fprintf(f, "%d,%u\n", k, counts[k]);
+    }
+    fclose(f);
+}
+
 // Function to initialize and start threads
 void start_threads(struct options opt)
 {
@@ -169,7 +505,7 @@ void start_threads(struct options opt)
     struct args *args;              //Pointer to an array of arg structures
     struct buffer buffer;           //Local variable that holds the shared data array and its size
 
-    srand(time(NULL));
+    printf("seed: %lu\n", opt.seed);    // Print the seed so the run can be repeated
 
     // Allocate memory for the buffer
     if((buffer.data=malloc(opt.buffer_size*sizeof(int)))==NULL) {
@@ -177,29 +513,37 @@ void start_threads(struct options opt)
         exit(1);
     }
     buffer.size = opt.buffer_size;          // Store the buffer size in the local variables
-    buffer.globalIter = opt.iterations;     // Initialize global iteration counter
-    buffer.stopIter = false;                // Initialize stop flag
 
-    // Allocate a mutex for each buffer position
-    buffer.positionsMutexs = malloc(buffer.size * sizeof(pthread_mutex_t));
-    if (buffer.positionsMutexs == NULL) {
-        printf("Out of memory for positions mutexes\n");
-        free(buffer.data);
+    // Distribution of the swapped positions, and the access counters when asked for
+    if (dist_init(&buffer.dist, opt.distribution, buffer.size) != 0) {
+        printf("'%s': is not a valid distribution\n", opt.distribution);
+        exit(1);
+    }
+    buffer.counts = NULL;
+    if (opt.counts_file != NULL && (buffer.counts = calloc(buffer.size, sizeof(uint32_t))) == NULL) {
+        printf("Out of memory for the access counts\n");
         exit(1);
     }
-    // Initialize buffer data and mutexes
+    atomic_init(&buffer.globalIter, opt.iterations);    // Initialize global iteration counter
+    buffer.stopIter = false;                // Initialize stop flag
+
+    // Initialize buffer data
     for (i = 0; i < buffer.size; i++) {
         buffer.data[i]=i;
-        if (pthread_mutex_init(&buffer.positionsMutexs[i], NULL) != 0) {
-            printf("Error initializing mutex for position %d\n", i);
-            exit(1);
-        }
     }
+
+    // Allocate a mutex for each buffer position, the striped lock table or the lock-free ownership words
+    init_locks(&buffer, opt.strategy, opt.lock_stripes);
+
     //Initialize the iteration mutex
     if (pthread_mutex_init(&buffer.iterMutex, NULL) != 0) {
         printf("Error initializing iter_mutex\n");
         exit(1);
     }
+    buffer.iterProf = NULL;
+#ifdef LOCK_PROFILE
+    buffer.iterProf = lock_prof_alloc("iterMutex", 1);
+#endif
 
     printf("creating %d threads\n", opt.num_threads);
 
@@ -213,8 +557,16 @@ void start_threads(struct options opt)
         exit(1);
     }
 
-    printf("Buffer before: ");
-    print_buffer(buffer);
+    if (!opt.verify) {
+        printf("Buffer before: ");
+        print_buffer(buffer);
+    }
+
+    // Start the trace flusher, with one ring per swap thread
+    if (trace_init(opt.trace, opt.trace_file, opt.num_threads, trace_events, NUM_EVENTS) != 0) {
+        printf("Could not start the trace log\n");
+        exit(1);
+    }
 
     /* --- Create the printer thread (using the extra element) --- */
 
@@ -223,6 +575,7 @@ void start_threads(struct options opt)
     args[opt.num_threads].thread_num = opt.num_threads;  // Identifier for the printer thread
     args[opt.num_threads].buffer     = &buffer;          // Assign the shared buffer to the printer thread's arguments
     args[opt.num_threads].delay      = opt.print_wait;   // Print interval (in microseconds)
+    args[opt.num_threads].print_sample = opt.print_sample; // Positions to print (0: all)
 
     if (pthread_create(&threads[opt.num_threads].thread_id, NULL, print_periodic, &args[opt.num_threads]) != 0) {
         printf("Could not create printer thread\n");
@@ -238,6 +591,7 @@ void start_threads(struct options opt)
         args[i].thread_num = i;
         args[i].buffer     = &buffer;
         args[i].delay      = opt.delay;
+        args[i].seed       = opt.seed;
 
         if ( 0 != pthread_create(&threads[i].thread_id, NULL,
                      swap, &args[i])) {
@@ -253,20 +607,37 @@ void start_threads(struct options opt)
     //flag was stablished to true in the last swap so printer thread can wait
     pthread_join(threads[opt.num_threads].thread_id, NULL);
 
+    // Write out the pending trace records
+    trace_finish();
+
     // Print the buffer
-    printf("Buffer after:  ");
-    qsort(buffer.data, opt.buffer_size, sizeof(int), (int (*)(const void *, const void *)) cmp);
-    print_buffer(buffer);
+    if (opt.verify) {
+        long bad = verify_permutation(buffer.data, sizeof(int), opt.buffer_size, opt.num_threads);
+        if (bad < 0)
+            printf("verify: PASS\n");
+        else
+            printf("verify: FAIL (position %ld holds %d)\n", bad, buffer.data[bad]);
+    } else {
+        printf("Buffer after:  ");
+        qsort(buffer.data, opt.buffer_size, sizeof(int), (int (*)(const void *, const void *)) cmp);
+        print_buffer(buffer);
+    }
 
     printf("iterations: %d\n", get_count());
 
-    // Destroy the mutexes and free memory
-    pthread_mutex_destroy(&buffer.iterMutex);
-    for (i = 0; i < buffer.size; i++) {
-        pthread_mutex_destroy(&buffer.positionsMutexs[i]);
+    if (buffer.counts != NULL) {
+        write_counts(opt.counts_file, buffer.counts, buffer.size);
+        free(buffer.counts);
     }
 
-    free(buffer.positionsMutexs);
+#ifdef LOCK_PROFILE
+    report_locks(&buffer);
+#endif
+
+    // Destroy the mutexes and free memory
+    pthread_mutex_destroy(&buffer.iterMutex);
+    free(buffer.iterProf);
+    destroy_locks(&buffer);
     free(args);
     free(threads);
     free(buffer.data);
@@ -284,7 +655,16 @@ int main (int argc, char **argv)
     opt.buffer_size = 10;
     opt.iterations  = 100;
     opt.delay       = 10;
+    opt.seed        = time(NULL);
+    opt.trace       = TRACE_TEXT;
+    opt.trace_file  = NULL;
+    opt.verify      = 0;
+    opt.distribution = "uniform";
+    opt.counts_file  = NULL;
     opt.print_wait  = 1;
+    opt.print_sample = 0;
+    opt.lock_stripes = 0;
+    opt.strategy    = STRATEGY_MUTEX;
 
     // Read options from command line arguments
     read_options(argc, argv, &opt);
@@ -0,0 +1,337 @@
+/*
+* TITLE: Primitives benchmark
+* SUBTITLE: Practical 2
+*
+* bench.c:
+    Runs the same microbenchmarks against the primitives of rec_mutex, rw_mutex and sem and against the
+    pthread built-ins they replace (recursive pthread_mutex_t, pthread_rwlock_t and POSIX sem_t), and prints
+    both in one table with their ratio:
+      - lock, read lock and reentry: uncontended latency of a lock/unlock pair, best of a few rounds. Reentry
+        is the nested lock/unlock of a recursive mutex that the thread already holds.
+      - contended: throughput of a number of threads locking the same object around a short busy work, with
+        a share of read locks for reader-writer locks. Writers increment a counter that is checked at the end.
+      - handoff: time from the unlock of a thread to the return of the lock of a thread that was sleeping on it.
+    Semaphores start at 1 and are used as a lock (P to lock, V to unlock). The primitives are built from their
+    own directories, so a regression in any of them shows up in its row.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "hist.h"
+#include "options.h"
+#include "prims.h"
+#include "rng.h"
+#include "work.h"
+
+#define UNCONTENDED_ROUNDS 3   // Uncontended measures keep the fastest of this many rounds
+#define HANDOFF_SLEEP_US 50    // Time given to the waiter to go to sleep before each handoff
+
+static int failed = 0;         // Some contended run lost updates
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Allocate and initialize an object of the primitive
+static void *new_prim(const struct prim *p)
+{
+    void *obj = malloc(p->size);
+
+    if (obj == NULL) {
+        printf("Not enough memory\n");
+        exit(1);
+    }
+    if (p->init(obj) != 0) {
+        printf("Could not initialize %s\n", p->name);
+        exit(1);
+    }
+    return obj;
+}
+
+static void free_prim(const struct prim *p, void *obj)
+{
+    p->destroy(obj);
+    free(obj);
+}
+
+enum uncontended_test { TEST_LOCK, TEST_READ_LOCK, TEST_REENTRY };
+
+// Nanoseconds of an uncontended lock/unlock pair
+static double uncontended(const struct prim *p, int test, long iterations)
+{
+    void *obj = new_prim(p);
+    double best = 0;
+
+    for (int round = 0; round < UNCONTENDED_ROUNDS; round++) {
+        uint64_t t0, t1;
+
+        if (test == TEST_REENTRY)
+            p->lock(obj);
+
+        t0 = now_ns();
+        if (test == TEST_READ_LOCK) {
+            for (long i = 0; i < iterations; i++) {
+                p->read_lock(obj);
+                p->read_unlock(obj);
+            }
+        } else {
+            for (long i = 0; i < iterations; i++) {
+                p->lock(obj);
+                p->unlock(obj);
+            }
+        }
+        t1 = now_ns();
+
+        if (test == TEST_REENTRY)
+            p->unlock(obj);
+
+        double ns = (double) (t1 - t0) / iterations;
+        if (round == 0 || ns < best)
+            best = ns;
+    }
+
+    free_prim(p, obj);
+    return best;
+}
+
+// Object shared by the threads of a contended run
+struct shared {
+    const struct prim *p;
+    void *obj;
+    long counter;               // incremented under the (write) lock
+    long ops;                   // lock/unlock pairs of each thread
+    int work_ns;
+    int reads;                  // percentage of read locks (reader-writer locks only)
+    pthread_barrier_t start;
+};
+
+struct worker {
+    pthread_t thread_id;
+    int thread_num;
+    struct shared *shared;
+    long writes;
+    uint64_t start, end;
+};
+
+static void *contended_thread(void *ptr)
+{
+    struct worker *w = ptr;
+    struct shared *s = w->shared;
+    const struct prim *p = s->p;
+    struct rng rng;
+
+    rng_seed(&rng, 1, w->thread_num);
+    w->writes = 0;
+
+    pthread_barrier_wait(&s->start);
+    w->start = now_ns();
+
+    for (long i = 0; i < s->ops; i++) {
+        if (p->read_lock != NULL && rng_below(&rng, 100) < s->reads) {
+            p->read_lock(s->obj);
+            (void) *(volatile long *) &s->counter;
+            work_ns(s->work_ns);
+            p->read_unlock(s->obj);
+        } else {
+            p->lock(s->obj);
+            s->counter++;
+            work_ns(s->work_ns);
+            p->unlock(s->obj);
+            w->writes++;
+        }
+    }
+
+    w->end = now_ns();
+    return NULL;
+}
+
+// Millions of lock/unlock pairs per second with num_threads threads on the same object
+static double contended(const struct prim *p, int num_threads, struct options *opt)
+{
+    struct shared s = { .p = p, .obj = new_prim(p), .counter = 0, .ops = opt->ops,
+                        .work_ns = opt->work_ns, .reads = opt->reads };
+    struct worker *workers = malloc(sizeof(struct worker) * num_threads);
+    uint64_t start = UINT64_MAX, end = 0;
+    long writes = 0;
+
+    if (workers == NULL) {
+        printf("Not enough memory\n");
+        exit(1);
+    }
+    pthread_barrier_init(&s.start, NULL, num_threads);
+
+    for (int i = 0; i < num_threads; i++) {
+        workers[i].thread_num = i;
+        workers[i].shared = &s;
+        if (pthread_create(&workers[i].thread_id, NULL, contended_thread, &workers[i]) != 0) {
+            printf("Could not create thread #%d\n", i);
+            exit(1);
+        }
+    }
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(workers[i].thread_id, NULL);
+        if (workers[i].start < start)
+            start = workers[i].start;
+        if (workers[i].end > end)
+            end = workers[i].end;
+        writes += workers[i].writes;
+    }
+
+    if (s.counter != writes) {
+        printf("%s with %d threads: counter is %ld after %ld writes\n", p->name, num_threads, s.counter, writes);
+        failed = 1;
+    }
+
+    pthread_barrier_destroy(&s.start);
+    free_prim(p, s.obj);
+    free(workers);
+    return (double) opt->ops * num_threads / (end - start) * 1000;
+}
+
+// State of a handoff measure. The main thread holds the lock and a second thread waits for it
+struct handoff {
+    const struct prim *p;
+    void *obj;
+    int rounds;
+    atomic_int round;           // round the holder is in
+    atomic_int waiting;         // last round the waiter is about to block in
+    atomic_int done;            // last round the waiter got the lock in
+    uint64_t unlock_time;       // written by the holder before unlocking, so read under the lock
+    struct hist latency;
+};
+
+static void *handoff_waiter(void *ptr)
+{
+    struct handoff *h = ptr;
+
+    for (int r = 1; r <= h->rounds; r++) {
+        while (atomic_load(&h->round) != r)
+            sched_yield();
+        atomic_store(&h->waiting, r);
+
+        h->p->lock(h->obj);
+        hist_record(&h->latency, now_ns() - h->unlock_time);
+        h->p->unlock(h->obj);
+
+        atomic_store(&h->done, r);
+    }
+    return NULL;
+}
+
+// Percentiles of the time from an unlock to the return of the lock of a sleeping thread
+static void handoff(const struct prim *p, int rounds, uint64_t *p50, uint64_t *p99)
+{
+    struct handoff h = { .p = p, .obj = new_prim(p), .rounds = rounds };
+    pthread_t waiter;
+
+    atomic_init(&h.round, 0);
+    atomic_init(&h.waiting, 0);
+    atomic_init(&h.done, 0);
+    hist_reset(&h.latency);
+
+    if (pthread_create(&waiter, NULL, handoff_waiter, &h) != 0) {
+        printf("Could not create the handoff thread\n");
+        exit(1);
+    }
+
+    for (int r = 1; r <= rounds; r++) {
+        p->lock(h.obj);
+        atomic_store(&h.round, r);
+        while (atomic_load(&h.waiting) != r)
+            sched_yield();
+        usleep(HANDOFF_SLEEP_US);
+
+        h.unlock_time = now_ns();
+        p->unlock(h.obj);
+
+        while (atomic_load(&h.done) != r)
+            sched_yield();
+    }
+    pthread_join(waiter, NULL);
+
+    *p50 = hist_percentile(&h.latency, 0.50);
+    *p99 = hist_percentile(&h.latency, 0.99);
+    free_prim(p, h.obj);
+}
+
+static void print_header(void)
+{
+    printf("%-12s %-12s %7s %-6s %14s %14s %8s\n",
+           "pair", "test", "threads", "unit", "custom", "pthread", "ratio");
+}
+
+// One line of the table. ratio is custom / pthread: below 1 is better for ns, above 1 for Mops/s
+static void print_row(const char *pair, const char *test, int threads, const char *unit, double custom, double builtin)
+{
+    printf("%-12s %-12s %7d %-6s %14.1f %14.1f %8.2f\n",
+           pair, test, threads, unit, custom, builtin, builtin > 0 ? custom / builtin : 0);
+    fflush(stdout);
+}
+
+static void run_pair(const struct prim_pair *pair, struct options *opt)
+{
+    const struct prim *custom = pair->custom, *builtin = pair->builtin;
+    uint64_t c50, c99, b50, b99;
+
+    print_row(pair->name, "lock", 1, "ns",
+              uncontended(custom, TEST_LOCK, opt->iterations), uncontended(builtin, TEST_LOCK, opt->iterations));
+    if (custom->read_lock != NULL)
+        print_row(pair->name, "read lock", 1, "ns",
+                  uncontended(custom, TEST_READ_LOCK, opt->iterations),
+                  uncontended(builtin, TEST_READ_LOCK, opt->iterations));
+    if (pair->recursive)
+        print_row(pair->name, "reentry", 1, "ns",
+                  uncontended(custom, TEST_REENTRY, opt->iterations),
+                  uncontended(builtin, TEST_REENTRY, opt->iterations));
+
+    for (int i = 0; i < opt->num_thread_counts; i++) {
+        int n = opt->thread_counts[i];
+        print_row(pair->name, "contended", n, "Mops/s", contended(custom, n, opt), contended(builtin, n, opt));
+    }
+
+    handoff(custom, opt->handoffs, &c50, &c99);
+    handoff(builtin, opt->handoffs, &b50, &b99);
+    print_row(pair->name, "handoff p50", 2, "ns", c50, b50);
+    print_row(pair->name, "handoff p99", 2, "ns", c99, b99);
+}
+
+int main(int argc, char **argv)
+{
+    struct options opt;
+
+    // Default values for the options
+    opt.num_pairs = num_prim_pairs;
+    for (int i = 0; i < num_prim_pairs; i++)
+        opt.pairs[i] = i;
+    opt.thread_counts[0] = 1;
+    opt.thread_counts[1] = 2;
+    opt.thread_counts[2] = 4;
+    opt.thread_counts[3] = 8;
+    opt.num_thread_counts = 4;
+    opt.iterations = 1000000;
+    opt.ops = 100000;
+    opt.work_ns = 100;
+    opt.reads = 90;
+    opt.handoffs = 1000;
+
+    read_options(argc, argv, &opt);
+
+    // Measure the busy work loop before any thread uses it
+    if (opt.work_ns > 0)
+        work_calibrate();
+
+    print_header();
+    for (int i = 0; i < opt.num_pairs; i++)
+        run_pair(&prim_pairs[opt.pairs[i]], &opt);
+
+    exit(failed);
+}
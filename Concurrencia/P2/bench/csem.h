@@ -0,0 +1,28 @@
+#ifndef __CSEM_H__
+#define __CSEM_H__
+
+/*
+ * csem.h:
+ * The semaphore of ../sem with the csem_ prefix it is compiled with here
+ * (see the Makefile), so it can be used next to POSIX <semaphore.h>.
+ */
+
+#define sem_t       csem_t
+#define sem_init    csem_init
+#define sem_destroy csem_destroy
+#define sem_p       csem_p
+#define sem_v       csem_v
+#define sem_tryp    csem_tryp
+#define sem_timedp  csem_timedp
+
+#include "sem.h"
+
+#undef sem_t
+#undef sem_init
+#undef sem_destroy
+#undef sem_p
+#undef sem_v
+#undef sem_tryp
+#undef sem_timedp
+
+#endif
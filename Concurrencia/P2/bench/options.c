@@ -0,0 +1,218 @@
+#include <getopt.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "options.h"
+
+static struct option long_options[] = {
+    { .name = "pairs",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'p'},
+    { .name = "threads",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 't'},
+    { .name = "iterations",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'i'},
+    { .name = "ops",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'n'},
+    { .name = "work-ns",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'w'},
+    { .name = "reads",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'R'},
+    { .name = "handoffs",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'H'},
+    { .name = "help",
+      .has_arg = no_argument,
+      .flag = NULL,
+      .val = 'h'},
+    {0, 0, 0, 0}
+};
+
+static void usage(int i)
+{
+    printf(
+        "Usage:  prim_bench [OPTION]\n"
+        "Runs the same microbenchmarks against rec_mutex, rw_mutex and sem and against\n"
+        "the pthread primitives they replace, printing one table with both.\n"
+        "Options:\n"
+        "  -p l, --pairs=<l>: comma separated pairs: mutex, mutex-fifo, rwlock, rwlock-bravo,\n"
+        "                     sem or all (default: all)\n"
+        "  -t l, --threads=<l>: comma separated numbers of threads of the contended runs (default: 1,2,4,8)\n"
+        "  -i n, --iterations=<n>: lock/unlock pairs of each uncontended measure\n"
+        "  -n n, --ops=<n>: lock/unlock pairs of each thread in a contended run\n"
+        "  -w n, --work-ns=<n>: busy work inside the critical section of the contended runs (ns)\n"
+        "  -R n, --reads=<n>: percentage of read locks in the contended runs of rwlock\n"
+        "  -H n, --handoffs=<n>: rounds of the handoff measure\n"
+        "  -h, --help: this message\n\n"
+    );
+    exit(i);
+}
+
+static int get_int(char *arg, int *value)
+{
+    char *end;
+    *value = strtol(arg, &end, 10);
+
+    return (end != arg && *end == '\0');
+}
+
+static int get_long(char *arg, long *value)
+{
+    char *end;
+    *value = strtol(arg, &end, 10);
+
+    return (end != arg && *end == '\0');
+}
+
+// Parse a comma separated list of positive integers into values. Returns the number of values, or -1
+static int get_int_list(char *arg, int *values, int max)
+{
+    char *end;
+    int n = 0;
+
+    while (*arg != '\0') {
+        if (n == max)
+            return -1;
+        values[n] = strtol(arg, &end, 10);
+        if (end == arg || values[n] <= 0 || (*end != ',' && *end != '\0'))
+            return -1;
+        n++;
+        arg = *end == ',' ? end + 1 : end;
+    }
+    return n;
+}
+
+// Parse a comma separated list of pair names. Returns the number of pairs, or -1
+static int get_pair_list(char *arg, int *pairs)
+{
+    char *name;
+    int n = 0;
+
+    if (strcmp(arg, "all") == 0) {
+        for (n = 0; n < num_prim_pairs; n++)
+            pairs[n] = n;
+        return n;
+    }
+    for (name = strtok(arg, ","); name != NULL; name = strtok(NULL, ",")) {
+        if (n == MAX_PAIRS || (pairs[n] = prim_pair_parse(name)) < 0)
+            return -1;
+        n++;
+    }
+    return n;
+}
+
+int handle_options(int argc, char **argv, struct options *opt)
+{
+    while (1) {
+        int c;
+        int option_index = 0;
+
+        c = getopt_long (argc, argv, "hp:t:i:n:w:R:H:",
+                 long_options, &option_index);
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'p':
+            if ((opt->num_pairs = get_pair_list(optarg, opt->pairs)) <= 0) {
+                printf("'%s': is not a valid list of pairs\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 't':
+            if ((opt->num_thread_counts = get_int_list(optarg, opt->thread_counts, MAX_THREAD_COUNTS)) <= 0) {
+                printf("'%s': is not a valid list of integers\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'i':
+            if (!get_long(optarg, &opt->iterations)
+                || opt->iterations <= 0) {
+                printf("'%s': is not a valid integer\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'n':
+            if (!get_long(optarg, &opt->ops)
+                || opt->ops <= 0) {
+                printf("'%s': is not a valid integer\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'w':
+            if (!get_int(optarg, &opt->work_ns)
+                || opt->work_ns < 0) {
+                printf("'%s': is not a valid integer\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'R':
+            if (!get_int(optarg, &opt->reads)
+                || opt->reads < 0 || opt->reads > 100) {
+                printf("'%s': is not a valid percentage\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'H':
+            if (!get_int(optarg, &opt->handoffs)
+                || opt->handoffs <= 0) {
+                printf("'%s': is not a valid integer\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case '?':
+        case 'h':
+            usage(0);
+            break;
+
+        default:
+            printf ("?? getopt returned character code 0%o ??\n", c);
+            usage(-1);
+        }
+    }
+    return 0;
+}
+
+int read_options(int argc, char **argv, struct options *opt) {
+
+    int result = handle_options(argc,argv,opt);
+
+    if (result != 0)
+        exit(result);
+
+    if (argc - optind != 0) {
+        printf ("Too many arguments\n\n");
+        while (optind < argc)
+            printf ("'%s' ", argv[optind++]);
+        printf ("\n");
+        usage(-2);
+    }
+
+    return 0;
+}
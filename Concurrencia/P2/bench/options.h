@@ -0,0 +1,29 @@
+#ifndef __OPTIONS_H__
+#define __OPTIONS_H__
+
+#include "prims.h"
+
+/*
+ * options.c y options.h:
+ * Gestionan la entrada de parámetros de línea de comandos del benchmark:
+ * primitivas a comparar, listas de hilos, iteraciones de cada prueba, etc.
+ */
+
+#define MAX_THREAD_COUNTS 32
+#define MAX_PAIRS 16
+
+struct options {
+	int pairs[MAX_PAIRS];                  // index in prim_pairs of each pair compared
+	int num_pairs;
+	int thread_counts[MAX_THREAD_COUNTS];  // threads of each contended run
+	int num_thread_counts;
+	long iterations;     // lock/unlock pairs of each uncontended measure
+	long ops;            // lock/unlock pairs of each thread in a contended run
+	int work_ns;         // busy work inside the critical section of the contended runs (in ns)
+	int reads;           // percentage of read locks in the contended runs of reader-writer locks
+	int handoffs;        // rounds of the handoff measure
+};
+
+int read_options(int argc, char **argv, struct options *opt);
+
+#endif
@@ -0,0 +1,122 @@
+#include <pthread.h>
+#include <semaphore.h>
+#include <string.h>
+#include "csem.h"
+#include "prims.h"
+#include "rec_mutex.h"
+#include "rw_mutex.h"
+
+// rec_mutex
+
+static int rec_init(void *p) { return rec_mutex_init_mode(p, REC_MUTEX_BARGING); }
+static int rec_fifo_init(void *p) { return rec_mutex_init_mode(p, REC_MUTEX_FIFO); }
+static void rec_destroy(void *p) { rec_mutex_destroy(p); }
+static void rec_lock(void *p) { rec_mutex_lock(p); }
+static void rec_unlock(void *p) { rec_mutex_unlock(p); }
+
+static const struct prim rec_prim = {
+    .name = "rec_mutex", .size = sizeof(rec_mutex_t), .init = rec_init, .destroy = rec_destroy,
+    .lock = rec_lock, .unlock = rec_unlock,
+};
+
+static const struct prim rec_fifo_prim = {
+    .name = "rec_mutex fifo", .size = sizeof(rec_mutex_t), .init = rec_fifo_init, .destroy = rec_destroy,
+    .lock = rec_lock, .unlock = rec_unlock,
+};
+
+// PTHREAD_MUTEX_RECURSIVE
+
+static int pmutex_init(void *p)
+{
+    pthread_mutexattr_t attr;
+    int r;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    r = pthread_mutex_init(p, &attr);
+    pthread_mutexattr_destroy(&attr);
+    return r;
+}
+static void pmutex_destroy(void *p) { pthread_mutex_destroy(p); }
+static void pmutex_lock(void *p) { pthread_mutex_lock(p); }
+static void pmutex_unlock(void *p) { pthread_mutex_unlock(p); }
+
+static const struct prim pmutex_prim = {
+    .name = "pthread_mutex", .size = sizeof(pthread_mutex_t), .init = pmutex_init, .destroy = pmutex_destroy,
+    .lock = pmutex_lock, .unlock = pmutex_unlock,
+};
+
+// rw_mutex
+
+static int rw_init(void *p) { return rw_mutex_init(p); }
+static int rw_bravo_init(void *p) { return rw_mutex_init_policy(p, RW_READER_BIASED); }
+static void rw_destroy(void *p) { rw_mutex_destroy(p); }
+static void rw_write_lock(void *p) { rw_mutex_writelock(p); }
+static void rw_write_unlock(void *p) { rw_mutex_writeunlock(p); }
+static void rw_read_lock(void *p) { rw_mutex_readlock(p); }
+static void rw_read_unlock(void *p) { rw_mutex_readunlock(p); }
+
+static const struct prim rw_prim = {
+    .name = "rw_mutex", .size = sizeof(rw_mutex_t), .init = rw_init, .destroy = rw_destroy,
+    .lock = rw_write_lock, .unlock = rw_write_unlock, .read_lock = rw_read_lock, .read_unlock = rw_read_unlock,
+};
+
+static const struct prim rw_bravo_prim = {
+    .name = "rw_mutex bravo", .size = sizeof(rw_mutex_t), .init = rw_bravo_init, .destroy = rw_destroy,
+    .lock = rw_write_lock, .unlock = rw_write_unlock, .read_lock = rw_read_lock, .read_unlock = rw_read_unlock,
+};
+
+// pthread_rwlock_t
+
+static int prw_init(void *p) { return pthread_rwlock_init(p, NULL); }
+static void prw_destroy(void *p) { pthread_rwlock_destroy(p); }
+static void prw_write_lock(void *p) { pthread_rwlock_wrlock(p); }
+static void prw_read_lock(void *p) { pthread_rwlock_rdlock(p); }
+static void prw_unlock(void *p) { pthread_rwlock_unlock(p); }
+
+static const struct prim prw_prim = {
+    .name = "pthread_rwlock", .size = sizeof(pthread_rwlock_t), .init = prw_init, .destroy = prw_destroy,
+    .lock = prw_write_lock, .unlock = prw_unlock, .read_lock = prw_read_lock, .read_unlock = prw_unlock,
+};
+
+// sem
+
+static int csem_prim_init(void *p) { return csem_init(p, 1); }
+static void csem_prim_destroy(void *p) { csem_destroy(p); }
+static void csem_prim_p(void *p) { csem_p(p); }
+static void csem_prim_v(void *p) { csem_v(p); }
+
+static const struct prim csem_prim = {
+    .name = "sem", .size = sizeof(csem_t), .init = csem_prim_init, .destroy = csem_prim_destroy,
+    .lock = csem_prim_p, .unlock = csem_prim_v,
+};
+
+// POSIX sem_t
+
+static int psem_init(void *p) { return sem_init(p, 0, 1); }
+static void psem_destroy(void *p) { sem_destroy(p); }
+static void psem_wait(void *p) { while (sem_wait(p) != 0); }    // Only fails when interrupted by a signal
+static void psem_post(void *p) { sem_post(p); }
+
+static const struct prim psem_prim = {
+    .name = "sem_t", .size = sizeof(sem_t), .init = psem_init, .destroy = psem_destroy,
+    .lock = psem_wait, .unlock = psem_post,
+};
+
+const struct prim_pair prim_pairs[] = {
+    { .name = "mutex",        .custom = &rec_prim,      .builtin = &pmutex_prim, .recursive = 1 },
+    { .name = "mutex-fifo",   .custom = &rec_fifo_prim, .builtin = &pmutex_prim, .recursive = 1 },
+    { .name = "rwlock",       .custom = &rw_prim,       .builtin = &prw_prim,    .recursive = 0 },
+    { .name = "rwlock-bravo", .custom = &rw_bravo_prim, .builtin = &prw_prim,    .recursive = 0 },
+    { .name = "sem",          .custom = &csem_prim,     .builtin = &psem_prim,   .recursive = 0 },
+};
+
+const int num_prim_pairs = sizeof(prim_pairs) / sizeof(prim_pairs[0]);
+
+int prim_pair_parse(const char *name)
+{
+    for (int i = 0; i < num_prim_pairs; i++)
+        if (strcmp(name, prim_pairs[i].name) == 0)
+            return i;
+    return -1;
+}
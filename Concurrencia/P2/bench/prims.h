@@ -0,0 +1,38 @@
+#ifndef __PRIMS_H__
+#define __PRIMS_H__
+
+#include <stddef.h>
+
+/*
+ * prims.c and prims.h:
+ * The primitives of rec_mutex, rw_mutex and sem, and the pthread built-ins
+ * they replace, behind the same set of operations, so every benchmark runs
+ * the same code against both.
+ */
+
+struct prim {
+	const char *name;
+	size_t size;                   // bytes of the object
+	int (*init)(void *p);          // semaphores start at 1, so they can be used as a lock
+	void (*destroy)(void *p);
+	void (*lock)(void *p);         // mutex lock, write lock or P
+	void (*unlock)(void *p);
+	void (*read_lock)(void *p);    // NULL if it is not a reader-writer lock
+	void (*read_unlock)(void *p);
+};
+
+// A primitive of ours and the built-in it is compared with
+struct prim_pair {
+	const char *name;
+	const struct prim *custom;
+	const struct prim *builtin;
+	int recursive;                 // lock can be taken again by its owner
+};
+
+extern const struct prim_pair prim_pairs[];
+extern const int num_prim_pairs;
+
+// Index of the pair with that name, -1 if there is none
+int prim_pair_parse(const char *name);
+
+#endif
@@ -3,6 +3,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "options.h"
+#include "rec_mutex.h"
+#include "trace.h"
 
 static struct option long_options[] = {
     { .name = "threads",
@@ -25,6 +27,30 @@ static struct option long_options[] = {
       .has_arg = required_argument,
       .flag = NULL,
       .val = 'p'},
+    { .name = "lock_timeout",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'L'},
+    { .name = "mode",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'm'},
+    { .name = "seed",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'r'},
+    { .name = "trace",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'T'},
+    { .name = "trace_file",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'o'},
+    { .name = "verify",
+      .has_arg = no_argument,
+      .flag = NULL,
+      .val = 'v'},
     { .name = "help",
       .has_arg = no_argument,
       .flag = NULL,
@@ -42,6 +68,12 @@ static void usage(int i)
         "  -i n, --iterations=<n>: total number of iterations\n"
         "  -d n, --delay=<n>: delay between buffer ops (us)\n"
         "  -p n, --print_wait=<n>: delay between prints of the array\n"
+        "  -L n, --lock_timeout=<n>: give up a swap when its locks take longer than this (us, 0: wait forever)\n"
+        "  -m m, --mode=<m>: how a released mutex is given to the waiters: barging (default) or fifo\n"
+        "  -r n, --seed=<n>: seed for the position generators (default: current time)\n"
+        "  -T m, --trace=<m>: trace log: off, text (default) or binary\n"
+        "  -o f, --trace_file=<f>: trace output (default: stdout, or trace.bin when binary)\n"
+        "  -v, --verify: check that the final buffer is a permutation, instead of printing it sorted\n"
         "  -h, --help: this message\n\n"
     );
     exit(i);
@@ -55,6 +87,14 @@ static int get_int(char *arg, int *value)
     return (end != NULL);
 }
 
+static int get_ulong(char *arg, unsigned long *value)
+{
+    char *end;
+    *value = strtoul(arg, &end, 10);
+
+    return (end != arg && *end == '\0');
+}
+
 /*
  * Uso de getopt_long en options.c:
     Se manejan diferentes opciones con nombres largos y cortos.
@@ -67,7 +107,7 @@ int handle_options(int argc, char **argv, struct options *opt)
         int c;
         int option_index = 0;
 
-        c = getopt_long (argc, argv, "ht:b:i:d:p:",
+        c = getopt_long (argc, argv, "hvt:b:i:d:p:L:m:r:T:o:",
                  long_options, &option_index);
         if (c == -1)
             break;
@@ -118,6 +158,46 @@ int handle_options(int argc, char **argv, struct options *opt)
             }
             break;
 
+        case 'L':
+            if (!get_int(optarg, &opt->lock_timeout)
+                || opt->lock_timeout < 0) {
+                printf("'%s': is not a valid integer\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'm':
+            if ((opt->mode = rec_mutex_mode_parse(optarg)) < 0) {
+                printf("'%s': is not a valid mutex mode\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'r':
+            if (!get_ulong(optarg, &opt->seed)) {
+                printf("'%s': is not a valid integer\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'T':
+            if ((opt->trace = trace_parse_mode(optarg)) < 0) {
+                printf("'%s': is not a valid trace mode\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'o':
+            opt->trace_file = optarg;
+            break;
+
+        case 'v':
+            opt->verify = 1;
+            break;
 
         case '?':
         case 'h':
@@ -13,6 +13,12 @@ struct options {
 	int iterations;
 	int delay;
     int print_wait;
+	int mode;            // enum rec_mutex_mode of the position mutexes
+	int lock_timeout;    // give up a swap when its locks take longer than this (in µs, 0: wait forever)
+	unsigned long seed;   // seed of the per-thread position generators
+	int trace;           // enum trace_mode
+	char *trace_file;    // trace output (NULL: default for the mode)
+	int verify;          // check that the final buffer is a permutation instead of printing it
 };
 
 int read_options(int argc, char **argv, struct options *opt);
@@ -1,64 +1,214 @@
 #include "rec_mutex.h"
+#include <errno.h>
+#include <linux/futex.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
 #include <unistd.h>
-#include <pthread.h>
 
-//We don't use the mutex because only one thread is creating the mutex so only one will access to it until this function comes to an end.
-int rec_mutex_init(rec_mutex_t *m) {
-    if (m == NULL) {
-        return -1;
+/*
+ * The lock word follows the three-state mutex of U. Drepper, "Futexes Are Tricky": taking a free mutex is one
+ * compare-and-swap from 0 to 1, and a thread that finds it taken sets it to 2 before sleeping in the kernel, so
+ * unlock only makes the futex syscall when someone may be waiting. The owner is kept apart from the lock word:
+ * only the owner can store its own id there, so a thread that reads its id back owns the mutex, and a re-entry
+ * is a load and an increment of count with no atomic read-modify-write at all.
+ *
+ * In FIFO mode the waiters queue up in arrival order, each sleeping on its own flag, and unlock hands the mutex
+ * to the head of the queue without ever setting the state to 0. The state only becomes 0 with nobody queued,
+ * so a newcomer can not take the mutex ahead of a waiter.
+ */
+
+//A thread waiting in FIFO mode, lives in the stack of that thread
+struct rec_mutex_waiter {
+    atomic_int granted;     //Set by unlock when the mutex has been handed to this thread
+    struct rec_mutex_waiter *next;
+};
+
+static __thread int self_tid;   //Cached id of the calling thread
+
+static int current_tid(void)
+{
+    if (self_tid == 0) {
+        self_tid = syscall(SYS_gettid);
     }
-    if (pthread_mutex_init(&m->m, NULL) != 0) {
-        return -1;
+    return self_tid;
+}
+
+//Sleep until woken or until the absolute CLOCK_MONOTONIC deadline (NULL: no deadline), returns ETIMEDOUT
+//once it has passed. FUTEX_WAIT takes a relative timeout, the bitset variant is the one that takes an absolute one.
+static int futex_wait_until(atomic_int *addr, int val, const struct timespec *deadline)
+{
+    if (syscall(SYS_futex, addr, FUTEX_WAIT_BITSET_PRIVATE, val, deadline, NULL, FUTEX_BITSET_MATCH_ANY) == -1) {
+        return errno;
     }
-    if (pthread_cond_init(&m->c, NULL) != 0) {
-        pthread_mutex_destroy(&m->m);
+    return 0;
+}
+
+static void futex_wake(atomic_int *addr, int n)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+//The queue is only held to link or unlink a waiter, so spinning is cheaper than sleeping
+static void queue_lock(rec_mutex_t *m)
+{
+    while (atomic_exchange_explicit(&m->qlock, 1, memory_order_acquire)) {
+        sched_yield();
+    }
+}
+
+static void queue_unlock(rec_mutex_t *m)
+{
+    atomic_store_explicit(&m->qlock, 0, memory_order_release);
+}
+
+//We don't use atomics because only one thread is creating the mutex so only one will access to it until this function comes to an end.
+int rec_mutex_init_mode(rec_mutex_t *m, int mode) {
+    if (m == NULL || (mode != REC_MUTEX_BARGING && mode != REC_MUTEX_FIFO)) {
         return -1;
     }
 
-    m->locker = (pthread_t)0;
+    atomic_init(&m->state, 0);
+    atomic_init(&m->owner, 0);
     m->count = 0;
+    m->mode = mode;
+    atomic_init(&m->qlock, 0);
+    m->head = m->tail = NULL;
 
     return 0;
 }
 
+int rec_mutex_init(rec_mutex_t *m) {
+    return rec_mutex_init_mode(m, REC_MUTEX_BARGING);
+}
+
 //PRECD: There is no threads using the mutex at this time
 int rec_mutex_destroy(rec_mutex_t *m) {
     if (m == NULL) {
         return -1;
     }
-    if (pthread_mutex_destroy(&m->m) != 0) {
-        return -1;
-    }
-    if (pthread_cond_destroy(&m->c) != 0) {
+    if (atomic_load(&m->state) != 0) {   //Still locked
         return -1;
     }
 
     return 0;
 }
 
-int rec_mutex_lock(rec_mutex_t *m) {
-    if (m == NULL) {
+//Slow path of barging mode: mark the mutex as having waiters and sleep until the owner releases it
+static int wait_barging(rec_mutex_t *m, int c, const struct timespec *deadline)
+{
+    if (c != 2) {
+        c = atomic_exchange_explicit(&m->state, 2, memory_order_acquire);
+    }
+    while (c != 0) {
+        int timedout = futex_wait_until(&m->state, 2, deadline) == ETIMEDOUT;
+        //Try once more after the timeout, the owner may have released it right at the deadline
+        c = atomic_exchange_explicit(&m->state, 2, memory_order_acquire);
+        if (timedout && c != 0) {
+            return -1;  //The state stays 2, at worst the owner makes one futex wake for nobody
+        }
+    }
+    return 0;
+}
+
+//Slow path of FIFO mode: join the end of the queue and sleep until unlock hands over the mutex
+static int wait_fifo(rec_mutex_t *m, const struct timespec *deadline)
+{
+    struct rec_mutex_waiter self;
+
+    atomic_init(&self.granted, 0);
+    self.next = NULL;
+
+    queue_lock(m);
+    int c = atomic_load_explicit(&m->state, memory_order_relaxed);
+    while (1) {
+        if (c == 0) {   //Released meanwhile, so there is nobody queued
+            if (atomic_compare_exchange_weak_explicit(&m->state, &c, 1, memory_order_acquire, memory_order_relaxed)) {
+                queue_unlock(m);
+                return 0;
+            }
+        } else if (c == 2 || atomic_compare_exchange_weak_explicit(&m->state, &c, 2, memory_order_relaxed, memory_order_relaxed)) {
+            break;      //With the state at 2 the owner has to go through the queue to unlock
+        }
+    }
+    if (m->tail != NULL) {
+        m->tail->next = &self;
+    } else {
+        m->head = &self;
+    }
+    m->tail = &self;
+    queue_unlock(m);
+
+    while (!atomic_load_explicit(&self.granted, memory_order_acquire)) {
+        if (futex_wait_until(&self.granted, 0, deadline) != ETIMEDOUT) {
+            continue;
+        }
+
+        queue_lock(m);
+        if (atomic_load_explicit(&self.granted, memory_order_acquire)) {   //Handed over right at the deadline
+            queue_unlock(m);
+            return 0;
+        }
+        struct rec_mutex_waiter *prev = NULL, *w = m->head;
+        while (w != &self) {
+            prev = w;
+            w = w->next;
+        }
+        if (prev != NULL) {
+            prev->next = self.next;
+        } else {
+            m->head = self.next;
+        }
+        if (m->tail == &self) {
+            m->tail = prev;
+        }
+        if (m->head == NULL) {
+            atomic_store_explicit(&m->state, 1, memory_order_relaxed);  //Nobody left, the owner can unlock fast again
+        }
+        queue_unlock(m);
         return -1;
     }
+    return 0;
+}
 
-    pthread_t self = pthread_self();
-    pthread_mutex_lock(&m->m);
+static int acquire(rec_mutex_t *m, const struct timespec *deadline)
+{
+    int self = current_tid();
 
-    if (pthread_equal (m->locker, self)) {  //We compare the thread which got the mutex and the parameter thread, at first m->locker is 0 so is going through the else
+    //Re-entry: only this thread can have stored its id in owner
+    if (atomic_load_explicit(&m->owner, memory_order_relaxed) == self) {
         m->count++;
-    }else {
-        while (m->count > 0) {  //The actual thread waits until its frees the mutex, here is where the real block between threads takes place.
-            pthread_cond_wait(&m->c, &m->m);
+        return 0;
+    }
+
+    int c = 0;
+    if (!atomic_compare_exchange_strong_explicit(&m->state, &c, 1, memory_order_acquire, memory_order_relaxed)) {
+        int r = m->mode == REC_MUTEX_FIFO ? wait_fifo(m, deadline) : wait_barging(m, c, deadline);
+        if (r != 0) {
+            return -1;
         }
-        m->locker = self;
-        m->count = 1;
     }
 
-    pthread_mutex_unlock(&m->m);
+    atomic_store_explicit(&m->owner, self, memory_order_relaxed);
+    m->count = 1;
 
     return 0;
+}
+
+int rec_mutex_lock(rec_mutex_t *m) {
+    if (m == NULL) {
+        return -1;
+    }
+    return acquire(m, NULL);
+};
+
+int rec_mutex_timedlock(rec_mutex_t *m, const struct timespec *deadline) {
+    if (m == NULL || deadline == NULL) {
+        return -1;
+    }
+    return acquire(m, deadline);
 };
 
 int rec_mutex_unlock(rec_mutex_t *m) {
@@ -66,21 +216,45 @@ int rec_mutex_unlock(rec_mutex_t *m) {
         return -1;
     }
 
-    pthread_t self = pthread_self();
-    pthread_mutex_lock(&m->m);
+    if (atomic_load_explicit(&m->owner, memory_order_relaxed) != current_tid()) {
+        return -1;
+    }
+    if (--m->count > 0) {
+        return 0;
+    }
+
+    atomic_store_explicit(&m->owner, 0, memory_order_relaxed);
 
-    if (pthread_equal (m->locker, self)) {
-        m->count--;
-        if (m->count == 0) {
-            m->locker = (pthread_t)0;
-            pthread_cond_signal(&m->c);
+    if (m->mode == REC_MUTEX_FIFO) {
+        int c = 1;
+        if (atomic_compare_exchange_strong_explicit(&m->state, &c, 0, memory_order_release, memory_order_relaxed)) {
+            return 0;   //Nobody queued
         }
-    }else{
-        pthread_mutex_unlock(&m->m);
-        return -1;
+
+        queue_lock(m);
+        struct rec_mutex_waiter *w = m->head;
+        if (w == NULL) {    //The waiters timed out
+            atomic_store_explicit(&m->state, 0, memory_order_release);
+        } else {
+            m->head = w->next;
+            if (m->head == NULL) {
+                m->tail = NULL;
+                atomic_store_explicit(&m->state, 1, memory_order_relaxed);
+            }
+            //The waiter may see the flag and return before the wake, so it can land on a reused stack slot.
+            //That is only a spurious wakeup, and every futex wait here checks its condition again.
+            atomic_store_explicit(&w->granted, 1, memory_order_release);
+            futex_wake(&w->granted, 1);
+        }
+        queue_unlock(m);
+        return 0;
     }
 
-    pthread_mutex_unlock(&m->m);
+    //Only wake a thread if some may be sleeping (state was 2)
+    if (atomic_fetch_sub_explicit(&m->state, 1, memory_order_release) != 1) {
+        atomic_store_explicit(&m->state, 0, memory_order_release);
+        futex_wake(&m->state, 1);
+    }
     return 0;
 };
 
@@ -89,20 +263,41 @@ int rec_mutex_trylock(rec_mutex_t *m) {    // 0 if sucessful, -1 if already lock
         return -1;
     }
 
-    pthread_t self = pthread_self();
-    int result = 0;
-
-    pthread_mutex_lock(&m->m);
+    int self = current_tid();
 
-    if (pthread_equal (m->locker, self)) {  //Parameter thread = thread which got the mutex
+    if (atomic_load_explicit(&m->owner, memory_order_relaxed) == self) {  //Calling thread = thread which got the mutex
         m->count++;
-    }else if (m->count == 0) {  //If no other thread owns the mutex
-        m->locker = self;
-        m->count = 1;
-    }else {     //Mutex is busy whit other thread
-        result = -1;
+        return 0;
+    }
+
+    //In FIFO mode the state is only 0 with nobody queued, so this never jumps the queue
+    int c = 0;
+    if (!atomic_compare_exchange_strong_explicit(&m->state, &c, 1, memory_order_acquire, memory_order_relaxed)) {
+        return -1;     //Mutex is busy whit other thread
     }
 
-    pthread_mutex_unlock(&m->m);
-    return result;
+    atomic_store_explicit(&m->owner, self, memory_order_relaxed);
+    m->count = 1;
+    return 0;
+};
+
+static const char *mode_names[] = {
+    [REC_MUTEX_BARGING] = "barging",
+    [REC_MUTEX_FIFO]    = "fifo",
 };
+
+const char *rec_mutex_mode_name(int mode) {
+    if (mode < REC_MUTEX_BARGING || mode > REC_MUTEX_FIFO) {
+        return "?";
+    }
+    return mode_names[mode];
+}
+
+int rec_mutex_mode_parse(const char *name) {
+    for (int mode = REC_MUTEX_BARGING; mode <= REC_MUTEX_FIFO; mode++) {
+        if (strcmp(name, mode_names[mode]) == 0) {
+            return mode;
+        }
+    }
+    return -1;
+}
@@ -1,20 +1,36 @@
 #ifndef __REC_MUTEX_H__
 #define __REC_MUTEX_H__
 
-#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+//How the mutex is given when it is released with threads waiting
+enum rec_mutex_mode {
+    REC_MUTEX_BARGING,  //Wake one waiter, any thread (even one just arriving) may take it first
+    REC_MUTEX_FIFO,     //Hand it directly to the thread that has waited longest
+};
+
+struct rec_mutex_waiter;
 
 typedef struct rec_mutex_t {
-    pthread_mutex_t m;  //The main mutex, it's not the recursive mutex, it's main goal is to protect the locker and count variables
-    pthread_cond_t c;   //Condition for the mutex
-    pthread_t locker;   //Which thread got the mutex
-    int count;  //How many locks the mutex have
+    atomic_int state;   //0: free, 1: locked, 2: locked and there may be threads waiting
+    atomic_int owner;   //Thread id (gettid) of the thread that got the mutex, 0 if none
+    int count;          //How many locks the mutex have, only read and written by the owner
+    int mode;           //enum rec_mutex_mode
+    atomic_int qlock;   //Spin lock of the waiters queue (FIFO mode)
+    struct rec_mutex_waiter *head, *tail;   //Waiting threads in arrival order (FIFO mode)
 } rec_mutex_t;
 
-int rec_mutex_init(rec_mutex_t *m);
+int rec_mutex_init(rec_mutex_t *m);     //Barging mode
+int rec_mutex_init_mode(rec_mutex_t *m, int mode);
 int rec_mutex_destroy(rec_mutex_t *m);
 
 int rec_mutex_lock(rec_mutex_t *m);
 int rec_mutex_unlock(rec_mutex_t *m);
 int rec_mutex_trylock(rec_mutex_t *m); // 0 if sucessful, -1 if already locked
+int rec_mutex_timedlock(rec_mutex_t *m, const struct timespec *deadline); // 0 if sucessful, -1 if the CLOCK_MONOTONIC deadline passed first
+
+const char *rec_mutex_mode_name(int mode);
+int rec_mutex_mode_parse(const char *name);    //-1 if it is not a mode
 
-#endif
\ No newline at end of file
+#endif
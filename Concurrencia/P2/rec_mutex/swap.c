@@ -7,12 +7,18 @@
  * DATE: 13 / 02 / 2025
  */
 #include <errno.h>
+#include <inttypes.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
+#include "hist.h"
 #include "op_count.h"
 #include "options.h"
+#include "rng.h"
+#include "trace.h"
+#include "verify.h"
 #include "rec_mutex.h"
 
 // Structure representing a shared buffer
@@ -31,33 +37,83 @@ struct args {
     int				thread_num;       // application defined thread #
     int				delay;			  // delay between operations
     int				iterations;       // number of iterations
+    int				lock_timeout;     // give up a swap after this long waiting for its locks (in µs, 0: never)
+    int				shed;             // swaps given up because the locks took too long
+    struct hist		wait;             // time taken to get both locks of each swap (in ns)
+    unsigned long	seed;             // seed of the position generator
     struct buffer	*buffer;		  // Shared buffer
 };
 
+// Trace events logged by the swap threads
+enum { EV_SWAP, NUM_EVENTS };
+
+static const char *trace_events[NUM_EVENTS] = {
+    [EV_SWAP] = "Thread %d swapping positions %d (== %d) and %d (== %d)\n",
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Lock the positions of a swap in order. Without a timeout this always succeeds; with one, both
+// locks share a deadline and -1 is returned, holding nothing, when it passes first.
+static int lock_positions(struct args *args, int first, int second)
+{
+    rec_mutex_t *mutexs = args->buffer->positionsMutexs;
+    struct timespec deadline;
+
+    if (args->lock_timeout == 0) {
+        rec_mutex_lock(&mutexs[first]);
+        rec_mutex_lock(&mutexs[second]);
+        return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += args->lock_timeout / 1000000;
+    deadline.tv_nsec += (long)(args->lock_timeout % 1000000) * 1000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    if (rec_mutex_timedlock(&mutexs[first], &deadline) != 0)
+        return -1;
+    if (rec_mutex_timedlock(&mutexs[second], &deadline) != 0) {
+        rec_mutex_unlock(&mutexs[first]);
+        return -1;
+    }
+    return 0;
+}
+
 // Function executed by each thread, swapping elements in the shared buffer
 void *swap(void *ptr)
 {
     struct args *args =  ptr;
+    struct rng rng;    // Private generator, so threads do not contend on rand()'s lock
+
+    rng_seed(&rng, args->seed, args->thread_num);
+    hist_reset(&args->wait);
 
     while(args->iterations--) {
         int i,j, tmp;
 
-        i=rand() % args->buffer->size;
-        j=rand() % args->buffer->size;
+        i=rng_below(&rng, args->buffer->size);
+        j=rng_below(&rng, args->buffer->size);
 
 
-        //Block with recursive mutexes
-        if (i < j) {
-            rec_mutex_lock(&args->buffer->positionsMutexs[i]);
-            rec_mutex_lock(&args->buffer->positionsMutexs[j]);
-        } else {
-            rec_mutex_lock(&args->buffer->positionsMutexs[j]);
-            rec_mutex_lock(&args->buffer->positionsMutexs[i]);
+        //Block with recursive mutexes, dropping the swap if they take too long
+        uint64_t t0 = now_ns();
+        if (lock_positions(args, i < j ? i : j, i < j ? j : i) != 0) {
+            args->shed++;
+            continue;
         }
+        hist_record(&args->wait, now_ns() - t0);
 
 
-        printf("Thread %d swapping positions %d (== %d) and %d (== %d)\n",
-            args->thread_num, i, args->buffer->data[i], j, args->buffer->data[j]);
+        TRACE(args->thread_num, EV_SWAP, args->thread_num, i, args->buffer->data[i], j, args->buffer->data[j]);
 
         tmp = args->buffer->data[i];
         if(args->delay) usleep(args->delay); // Force a context switch
@@ -98,7 +154,7 @@ void start_threads(struct options opt)
     struct args *args;              //Pointer to an array of arg structures
     struct buffer buffer;           //Local variable that holds the shared data array and its size
 
-    srand(time(NULL));    // Seed random number generator
+    printf("seed: %lu\n", opt.seed);    // Print the seed so the run can be repeated
 
     if((buffer.data=malloc(opt.buffer_size*sizeof(int)))==NULL) {
         printf("Out of memory\n");
@@ -116,7 +172,7 @@ void start_threads(struct options opt)
     // Initialize buffer data and mutexes
     for (i = 0; i < buffer.size; i++) {
         buffer.data[i]=i;
-        if (rec_mutex_init(&buffer.positionsMutexs[i]) != 0) {
+        if (rec_mutex_init_mode(&buffer.positionsMutexs[i], opt.mode) != 0) {
             printf("Error initializing mutex for position %d\n", i);
             exit(1);
         }
@@ -133,8 +189,16 @@ void start_threads(struct options opt)
         exit(1);
     }
 
-    printf("Buffer before: ");
-    print_buffer(buffer);
+    if (!opt.verify) {
+        printf("Buffer before: ");
+        print_buffer(buffer);
+    }
+
+    // Start the trace flusher, with one ring per swap thread
+    if (trace_init(opt.trace, opt.trace_file, opt.num_threads, trace_events, NUM_EVENTS) != 0) {
+        printf("Could not start the trace log\n");
+        exit(1);
+    }
 
 
     // Create num_thread threads running swap()
@@ -144,7 +208,10 @@ void start_threads(struct options opt)
         args[i].thread_num = i;
         args[i].buffer     = &buffer;
         args[i].delay      = opt.delay;
+        args[i].seed       = opt.seed;
         args[i].iterations = opt.iterations;
+        args[i].lock_timeout = opt.lock_timeout;
+        args[i].shed       = 0;
 
         if (pthread_create(&threads[i].thread_id, NULL, swap, &args[i]) != 0) {
             printf("Could not create thread #%d", i);
@@ -156,13 +223,40 @@ void start_threads(struct options opt)
     for (i = 0; i < opt.num_threads; i++)
         pthread_join(threads[i].thread_id, NULL);
 
+    // Write out the pending trace records
+    trace_finish();
+
     // Print sorted buffer after operations
-    printf("Buffer after:  ");
-    qsort(buffer.data, opt.buffer_size, sizeof(int), (int (*)(const void *, const void *)) cmp);
-    print_buffer(buffer);
+    if (opt.verify) {
+        long bad = verify_permutation(buffer.data, sizeof(int), opt.buffer_size, opt.num_threads);
+        if (bad < 0)
+            printf("verify: PASS\n");
+        else
+            printf("verify: FAIL (position %ld holds %d)\n", bad, buffer.data[bad]);
+    } else {
+        printf("Buffer after:  ");
+        qsort(buffer.data, opt.buffer_size, sizeof(int), (int (*)(const void *, const void *)) cmp);
+        print_buffer(buffer);
+    }
 
     printf("iterations: %d\n", get_count());
 
+    // Acquisition latency of the swaps that got their locks
+    struct hist wait;
+    hist_reset(&wait);
+    for (i = 0; i < opt.num_threads; i++)
+        hist_merge(&wait, &args[i].wait);
+    printf("lock wait (%s): p50 %" PRIu64 " ns, p99 %" PRIu64 " ns, p999 %" PRIu64 " ns\n",
+           rec_mutex_mode_name(opt.mode), hist_percentile(&wait, 0.50),
+           hist_percentile(&wait, 0.99), hist_percentile(&wait, 0.999));
+
+    if (opt.lock_timeout > 0) {
+        int shed = 0;
+        for (i = 0; i < opt.num_threads; i++)
+            shed += args[i].shed;
+        printf("shed: %d swaps gave up after waiting %d us for their locks\n", shed, opt.lock_timeout);
+    }
+
     // Destroy mutexes and free memory
     for (i = 0; i < buffer.size; i++) {
         rec_mutex_destroy(&buffer.positionsMutexs[i]);
@@ -184,6 +278,12 @@ int main (int argc, char **argv)
     opt.buffer_size = 10;
     opt.iterations  = 10;
     opt.delay       = 10;
+    opt.seed        = time(NULL);
+    opt.trace       = TRACE_TEXT;
+    opt.trace_file  = NULL;
+    opt.verify      = 0;
+    opt.lock_timeout = 0;
+    opt.mode        = REC_MUTEX_BARGING;
 
     // Read options from command line arguments
     read_options(argc, argv, &opt);
@@ -1,16 +1,35 @@
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <time.h>
 #include <unistd.h>
+#include "affinity.h"
+#include "hist.h"
 #include "rw_mutex.h"
 #include "options.h"
+#include "rcu.h"
+#include "seqlock.h"
+#include "trace.h"
+#include "work.h"
 
 
 
+// Version of the shared state published by the writers with --lock=rcu
+struct state {
+    int counter;
+};
+
 // Structure representing a shared buffer
 struct buffer {
-    int counter;
+    atomic_int counter;             // atomic so seqlock readers can copy it while a writer changes it
     rw_mutex_t counter_mutex;
+    seqlock_t counter_seq;          // used instead of counter_mutex with --lock=seqlock
+    _Atomic(struct state *) state;  // used instead of counter with --lock=rcu, replaced by each write
+    pthread_mutex_t state_writers;  // serializes the writers of state
+    rcu_t rcu;                      // frees the versions of state no reader can see anymore
 };
 
 struct thread_info {
@@ -21,20 +40,98 @@ struct thread_info {
 struct args {
     int				thread_num;       // application defined thread #
     int				delay;			  // delay between operations
+    int				work_ns;          // busy work inside the critical section (in ns)
+    int				think_ns;         // busy work between operations (in ns)
     int				iterations;       // number of iterations
+    int				lock_timeout;     // give up an operation after this long waiting for the lock (in µs, 0: never)
+    int				upgrade;          // writers read the counter with an upgradeable lock before writing
+    int				shed;             // operations given up because the lock took too long
+    int				done;             // operations that got the lock
+    long			retries;          // seqlock reads started again because a writer changed the counter
+    uint64_t		start, end;       // when the thread started and finished its operations (in ns)
+    struct hist		wait;             // time taken to get the lock (in ns)
+    int				trace_slot;       // trace ring of the thread (readers first, then writers)
     struct buffer	*buffer;		  // Shared buffer
 };
 
+// Trace events logged by the readers and writers
+enum { EV_READ, EV_WRITE, NUM_EVENTS };
+
+static const char *trace_events[NUM_EVENTS] = {
+    [EV_READ]  = "Reader %d: Counter = %d\n",
+    [EV_WRITE] = "Writer %d: Incremented counter to %d\n",
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Absolute CLOCK_MONOTONIC deadline usecs from now
+static void deadline_after(struct timespec *deadline, int usecs)
+{
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += usecs / 1000000;
+    deadline->tv_nsec += (long)(usecs % 1000000) * 1000;
+    if (deadline->tv_nsec >= 1000000000) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000;
+    }
+}
+
+// Take the lock for reading or writing, giving up with -1 after the thread's lock timeout
+static int acquire(struct args *thread_args, int write)
+{
+    rw_mutex_t *m = &thread_args->buffer->counter_mutex;
+    struct timespec deadline;
+    uint64_t t0 = now_ns();
+
+    if (thread_args->lock_timeout == 0) {
+        if (write)
+            rw_mutex_writelock(m);
+        else
+            rw_mutex_readlock(m);
+    } else if ((write ? rw_mutex_trywritelock(m) : rw_mutex_tryreadlock(m)) != 0) {
+        // Only work out the deadline when the lock is not free
+        deadline_after(&deadline, thread_args->lock_timeout);
+        if ((write ? rw_mutex_timedwritelock(m, &deadline) : rw_mutex_timedreadlock(m, &deadline)) != 0) {
+            thread_args->shed++;
+            return -1;
+        }
+    }
+    hist_record(&thread_args->wait, now_ns() - t0);
+    thread_args->done++;
+    return 0;
+}
+
+static int counter_get(struct buffer *buffer)
+{
+    return atomic_load_explicit(&buffer->counter, memory_order_relaxed);
+}
+
+// Only called with the other writers excluded, so it needs no read-modify-write
+static void counter_increment(struct buffer *buffer)
+{
+    atomic_store_explicit(&buffer->counter, counter_get(buffer) + 1, memory_order_relaxed);
+}
+
 // Thread function for readers
 void *reader(void *arg) {
     struct args *thread_args = (struct args *)arg;
 
+    thread_args->start = now_ns();
     for (int i = 0; i < thread_args->iterations; i++) {
-        rw_mutex_readlock(&thread_args->buffer->counter_mutex);
-        printf("Reader %d: Counter = %d\n", thread_args->thread_num, thread_args->buffer->counter);
+        if (acquire(thread_args, 0) != 0)
+            continue;
+        TRACE(thread_args->trace_slot, EV_READ, thread_args->thread_num, counter_get(thread_args->buffer));
+        work_ns(thread_args->work_ns);
         rw_mutex_readunlock(&thread_args->buffer->counter_mutex);
-        usleep(thread_args->delay); // Delay between reads
+        work_ns(thread_args->think_ns);
+        if (thread_args->delay) usleep(thread_args->delay); // Delay between reads
     }
+    thread_args->end = now_ns();
     return NULL;
 }
 
@@ -42,61 +139,246 @@ void *reader(void *arg) {
 void *writer(void *arg) {
     struct args *thread_args = (struct args *)arg;
 
+    thread_args->start = now_ns();
     for (int i = 0; i < thread_args->iterations; i++) {
-        rw_mutex_writelock(&thread_args->buffer->counter_mutex);
-        thread_args->buffer->counter++;
-        printf("Writer %d: Incremented counter to %d\n", thread_args->thread_num, thread_args->buffer->counter);
+        if (acquire(thread_args, 1) != 0)
+            continue;
+        counter_increment(thread_args->buffer);
+        TRACE(thread_args->trace_slot, EV_WRITE, thread_args->thread_num, counter_get(thread_args->buffer));
+        work_ns(thread_args->work_ns);
         rw_mutex_writeunlock(&thread_args->buffer->counter_mutex);
-        usleep(thread_args->delay); // Delay between writes
+        work_ns(thread_args->think_ns);
+        if (thread_args->delay) usleep(thread_args->delay); // Delay between writes
     }
+    thread_args->end = now_ns();
     return NULL;
 }
 
-// Function to start threads
-void start_threads(struct options opt) {
+// Thread function for writers with --upgrade: read the counter, then increment what was read without letting
+// another writer in between, and check the result still holding the lock for reading
+void *upgrade_writer(void *arg) {
+    struct args *thread_args = (struct args *)arg;
+    rw_mutex_t *m = &thread_args->buffer->counter_mutex;
 
-    struct thread_info *threads;    //Pointer to an array of thread_info structures
-    struct args *args;              //Pointer to an array of arg structures
+    thread_args->start = now_ns();
+    for (int i = 0; i < thread_args->iterations; i++) {
+        uint64_t t0 = now_ns();
+        rw_mutex_upgradelock(m);
+        uint64_t wait = now_ns() - t0;
+        int seen = counter_get(thread_args->buffer);
+        work_ns(thread_args->work_ns);
+
+        // The wait for the other readers to leave counts as lock wait too
+        t0 = now_ns();
+        rw_mutex_upgrade(m);
+        hist_record(&thread_args->wait, wait + now_ns() - t0);
+        thread_args->done++;
+        atomic_store_explicit(&thread_args->buffer->counter, seen + 1, memory_order_relaxed);
+        TRACE(thread_args->trace_slot, EV_WRITE, thread_args->thread_num, seen + 1);
+
+        rw_mutex_downgrade(m);
+        if (counter_get(thread_args->buffer) != seen + 1) {
+            printf("Error: writer %d incremented %d, but the counter is %d\n",
+                   thread_args->thread_num, seen, counter_get(thread_args->buffer));
+            exit(1);
+        }
+        rw_mutex_readunlock(m);
+        work_ns(thread_args->think_ns);
+        if (thread_args->delay) usleep(thread_args->delay); // Delay between writes
+    }
+    thread_args->end = now_ns();
+    return NULL;
+}
+
+// Thread function for readers with --lock=seqlock: copy the counter until no writer got in the way
+void *seq_reader(void *arg) {
+    struct args *thread_args = (struct args *)arg;
+    seqlock_t *s = &thread_args->buffer->counter_seq;
+
+    thread_args->start = now_ns();
+    for (int i = 0; i < thread_args->iterations; i++) {
+        unsigned start;
+        int counter;
+        uint64_t t0 = now_ns(), t1;
+
+        // The wait is the time until the copy that succeeded began, failed copies included
+        start = seq_read_begin(s);
+        t1 = now_ns();
+        while (1) {
+            counter = counter_get(thread_args->buffer);
+            work_ns(thread_args->work_ns);
+            if (!seq_read_retry(s, start))
+                break;
+            thread_args->retries++;
+            start = seq_read_begin(s);
+            t1 = now_ns();
+        }
+        hist_record(&thread_args->wait, t1 - t0);
+        thread_args->done++;
+        TRACE(thread_args->trace_slot, EV_READ, thread_args->thread_num, counter);
+        work_ns(thread_args->think_ns);
+        if (thread_args->delay) usleep(thread_args->delay); // Delay between reads
+    }
+    thread_args->end = now_ns();
+    return NULL;
+}
+
+// Thread function for writers with --lock=seqlock
+void *seq_writer(void *arg) {
+    struct args *thread_args = (struct args *)arg;
+    seqlock_t *s = &thread_args->buffer->counter_seq;
+
+    thread_args->start = now_ns();
+    for (int i = 0; i < thread_args->iterations; i++) {
+        uint64_t t0 = now_ns();
+        seq_write_begin(s);
+        hist_record(&thread_args->wait, now_ns() - t0);
+        thread_args->done++;
+
+        counter_increment(thread_args->buffer);
+        TRACE(thread_args->trace_slot, EV_WRITE, thread_args->thread_num, counter_get(thread_args->buffer));
+        work_ns(thread_args->work_ns);
+        seq_write_end(s);
+        work_ns(thread_args->think_ns);
+        if (thread_args->delay) usleep(thread_args->delay); // Delay between writes
+    }
+    thread_args->end = now_ns();
+    return NULL;
+}
+
+// Thread function for readers with --lock=rcu: read the current version, never waiting for the writers
+void *rcu_reader(void *arg) {
+    struct args *thread_args = (struct args *)arg;
+    struct buffer *buffer = thread_args->buffer;
+
+    thread_args->start = now_ns();
+    for (int i = 0; i < thread_args->iterations; i++) {
+        uint64_t t0 = now_ns();
+        if (rcu_read_lock(&buffer->rcu) != 0) {
+            printf("Too many rcu readers\n");
+            exit(1);
+        }
+        hist_record(&thread_args->wait, now_ns() - t0);
+        thread_args->done++;
+
+        struct state *state = atomic_load_explicit(&buffer->state, memory_order_acquire);
+        TRACE(thread_args->trace_slot, EV_READ, thread_args->thread_num, state->counter);
+        work_ns(thread_args->work_ns);
+        rcu_read_unlock(&buffer->rcu);
+        work_ns(thread_args->think_ns);
+        if (thread_args->delay) usleep(thread_args->delay); // Delay between reads
+    }
+    thread_args->end = now_ns();
+    return NULL;
+}
+
+// Thread function for writers with --lock=rcu: publish a copy of the state with the counter incremented
+void *rcu_writer(void *arg) {
+    struct args *thread_args = (struct args *)arg;
+    struct buffer *buffer = thread_args->buffer;
+
+    thread_args->start = now_ns();
+    for (int i = 0; i < thread_args->iterations; i++) {
+        uint64_t t0 = now_ns();
+        pthread_mutex_lock(&buffer->state_writers);
+        hist_record(&thread_args->wait, now_ns() - t0);
+        thread_args->done++;
+
+        struct state *old = atomic_load_explicit(&buffer->state, memory_order_relaxed);
+        struct state *new = malloc(sizeof(struct state));
+        if (new == NULL) {
+            printf("Not enough memory\n");
+            exit(1);
+        }
+        new->counter = old->counter + 1;
+        work_ns(thread_args->work_ns);
+        atomic_store_explicit(&buffer->state, new, memory_order_release);
+        TRACE(thread_args->trace_slot, EV_WRITE, thread_args->thread_num, new->counter);
+        pthread_mutex_unlock(&buffer->state_writers);
+
+        rcu_defer_free(&buffer->rcu, old, free);    // Readers may still be using it
+        work_ns(thread_args->think_ns);
+        if (thread_args->delay) usleep(thread_args->delay); // Delay between writes
+    }
+    thread_args->end = now_ns();
+    return NULL;
+}
+
+// Set the arguments of a reader or writer thread
+static void init_args(struct args *args, int thread_num, int trace_slot, struct options *opt, struct buffer *buffer)
+{
+    args->thread_num = thread_num;
+    args->delay = opt->delay;
+    args->work_ns = opt->work_ns;
+    args->think_ns = opt->think_ns;
+    args->iterations = opt->iterations;
+    args->lock_timeout = opt->lock_timeout;
+    args->upgrade = opt->upgrade;
+    args->shed = 0;
+    args->done = 0;
+    args->retries = 0;
+    hist_reset(&args->wait);
+    args->trace_slot = trace_slot;
+    args->buffer = buffer;
+}
+
+// Run the readers and writers once with the lock under the given policy (ignored for seqlock and rcu),
+// and print a summary of the run
+static void run_policy(struct options *opt, int policy, struct affinity *aff,
+                       struct thread_info *threads, struct args *args)
+{
     struct buffer shared_buffer;           //Local variable that holds the shared data array and its size
+    pthread_attr_t attr;
+    int total_threads = opt->num_readers + opt->num_writers;
+    int seq = opt->lock == LOCK_SEQLOCK;
+    int rcu = opt->lock == LOCK_RCU;
+    void *(*reader_fn)(void *) = seq ? seq_reader : rcu ? rcu_reader : reader;
+    void *(*writer_fn)(void *) = seq ? seq_writer : rcu ? rcu_writer : opt->upgrade ? upgrade_writer : writer;
 
     // Initialize read-write mutex
-    if (rw_mutex_init(&shared_buffer.counter_mutex) != 0) {
+    if (rw_mutex_init_policy(&shared_buffer.counter_mutex, policy) != 0) {
         printf("Error initializing rw_mutex\n");
-        return;
+        exit(1);
     }
-    shared_buffer.counter = 0;
-
-    int total_threads = opt.num_readers + opt.num_writers;
-    threads = malloc(sizeof(struct thread_info) * total_threads);
-    args = malloc(sizeof(struct args) * total_threads);
+    if (seqlock_init(&shared_buffer.counter_seq) != 0) {
+        printf("Error initializing seqlock\n");
+        exit(1);
+    }
+    atomic_init(&shared_buffer.counter, 0);
+    struct state *state = malloc(sizeof(struct state));
+    if (state == NULL || rcu_init(&shared_buffer.rcu) != 0
+        || pthread_mutex_init(&shared_buffer.state_writers, NULL) != 0) {
+        printf("Error initializing the rcu state\n");
+        exit(1);
+    }
+    state->counter = 0;
+    atomic_init(&shared_buffer.state, state);
 
     // Create reader threads
-    for (int i = 0; i < opt.num_readers; i++) {
-        args[i].thread_num = i;
-        args[i].delay = opt.delay;
-        args[i].iterations = opt.iterations;
-        args[i].buffer = &shared_buffer;
+    for (int i = 0; i < opt->num_readers; i++) {
+        init_args(&args[i], i, i, opt, &shared_buffer);
 
-        if (pthread_create(&threads[i].thread_id, NULL, reader, &args[i]) != 0) {
+        affinity_attr(aff, i, &attr);
+        if (pthread_create(&threads[i].thread_id, &attr, reader_fn, &args[i]) != 0) {
             printf("Error creating reader thread %d\n", i);
-            return;
+            exit(1);
         }
+        pthread_attr_destroy(&attr);
         threads[i].thread_num = i;
     }
 
     int index = 0;
     // Create writer threads
-    for (int i = 0; i < opt.num_writers; i++) {
-        index = opt.num_readers + i;
-        args[index].thread_num = i;
-        args[index].delay = opt.delay;
-        args[index].iterations = opt.iterations;
-        args[index].buffer = &shared_buffer;
-
-        if (pthread_create(&threads[index].thread_id, NULL, writer, &args[index]) != 0) {
+    for (int i = 0; i < opt->num_writers; i++) {
+        index = opt->num_readers + i;
+        init_args(&args[index], i, index, opt, &shared_buffer);
+
+        affinity_attr(aff, index, &attr);
+        if (pthread_create(&threads[index].thread_id, &attr, writer_fn, &args[index]) != 0) {
             printf("Error creating writer thread %d\n", i);
-            return;
+            exit(1);
         }
+        pthread_attr_destroy(&attr);
         threads[index].thread_num = i;
     }
 
@@ -105,8 +387,107 @@ void start_threads(struct options opt) {
         pthread_join(threads[i].thread_id, NULL);
     }
 
-    // Cleanup
+    // Reader throughput and reader and writer latency over the whole run
+    struct hist read_wait, write_wait;
+    uint64_t start = UINT64_MAX, end = 0;
+    long reads = 0, writes = 0, retries = 0;
+    int read_shed = 0, write_shed = 0;
+
+    hist_reset(&read_wait);
+    hist_reset(&write_wait);
+    for (int i = 0; i < total_threads; i++) {
+        if (args[i].start < start)
+            start = args[i].start;
+        if (args[i].end > end)
+            end = args[i].end;
+        if (i < opt->num_readers) {
+            reads += args[i].done;
+            retries += args[i].retries;
+            read_shed += args[i].shed;
+            hist_merge(&read_wait, &args[i].wait);
+        } else {
+            writes += args[i].done;
+            write_shed += args[i].shed;
+            hist_merge(&write_wait, &args[i].wait);
+        }
+    }
+    double secs = (end - start) / 1e9;
+    if (seq || rcu)
+        printf("lock %s: ", seq ? "seqlock" : "rcu");
+    else
+        printf("policy %s: ", rw_policy_name(policy));
+    printf("%d readers, %d writers: %.0f reads/s, %.0f writes/s\n",
+           opt->num_readers, opt->num_writers, reads / secs, writes / secs);
+    printf("  read wait p50 %" PRIu64 " ns, p99 %" PRIu64 " ns, p999 %" PRIu64 " ns; "
+           "write wait p50 %" PRIu64 " ns, p99 %" PRIu64 " ns, p999 %" PRIu64 " ns\n",
+           hist_percentile(&read_wait, 0.50), hist_percentile(&read_wait, 0.99),
+           hist_percentile(&read_wait, 0.999), hist_percentile(&write_wait, 0.50),
+           hist_percentile(&write_wait, 0.99), hist_percentile(&write_wait, 0.999));
+
+    if (seq) {
+        printf("read retries: %ld (%.3f per read)\n", retries, reads > 0 ? (double) retries / reads : 0);
+    }
+
+    if (opt->lock_timeout > 0 && !seq && !rcu) {
+        printf("shed: %d reads and %d writes gave up after waiting %d us for the lock\n",
+               read_shed, write_shed, opt->lock_timeout);
+    }
+
+    state = atomic_load(&shared_buffer.state);
+    int counter = rcu ? state->counter : counter_get(&shared_buffer);
+    if (counter != writes) {
+        printf("Error: counter is %d after %ld writes\n", counter, writes);
+        exit(1);
+    }
+
+    rcu_destroy(&shared_buffer.rcu);
+    free(state);
+    pthread_mutex_destroy(&shared_buffer.state_writers);
+    seqlock_destroy(&shared_buffer.counter_seq);
     rw_mutex_destroy(&shared_buffer.counter_mutex);
+}
+
+// Function to start threads
+void start_threads(struct options opt) {
+
+    struct thread_info *threads;    //Pointer to an array of thread_info structures
+    struct args *args;              //Pointer to an array of arg structures
+    struct affinity aff;                   //CPU of each thread: readers first, then writers
+
+    if (affinity_init(&aff, opt.pin) != 0) {
+        printf("'%s': is not a valid placement\n", opt.pin);
+        exit(1);
+    }
+    affinity_print(&aff, stdout, "");
+
+    int total_threads = opt.num_readers + opt.num_writers;
+    threads = malloc(sizeof(struct thread_info) * total_threads);
+    args = malloc(sizeof(struct args) * total_threads);
+    if (threads == NULL || args == NULL) {
+        printf("Not enough memory\n");
+        exit(1);
+    }
+
+    // Start the trace flusher, with one ring per thread
+    if (trace_init(opt.trace, opt.trace_file, total_threads, trace_events, NUM_EVENTS) != 0) {
+        printf("Error starting the trace log\n");
+        exit(1);
+    }
+
+    // One run for each policy, with the same threads and operations. The seqlock and rcu have no policies
+    if (opt.lock != LOCK_RW_MUTEX) {
+        run_policy(&opt, RW_PREFER_READERS, &aff, threads, args);
+    } else {
+        for (int p = 0; p < opt.num_policies; p++) {
+            run_policy(&opt, opt.policies[p], &aff, threads, args);
+        }
+    }
+
+    // Write out the pending trace records
+    trace_finish();
+
+    // Cleanup
+    affinity_destroy(&aff);
     free(threads);
     free(args);
 }
@@ -120,10 +501,24 @@ int main(int argc, char **argv) {
     opt.num_writers = 2;
     opt.iterations = 100;
     opt.delay = 10;
+    opt.work_ns = 0;
+    opt.think_ns = 0;
+    opt.lock_timeout = 0;
+    opt.lock = LOCK_RW_MUTEX;
+    opt.upgrade = 0;
+    opt.policies[0] = RW_PREFER_READERS;
+    opt.num_policies = 1;
+    opt.trace = TRACE_TEXT;
+    opt.trace_file = NULL;
+    opt.pin = "none";
 
     // Parse command-line options
     read_options(argc, argv, &opt);
 
+    // Measure the busy work loop before any thread uses it
+    if (opt.work_ns > 0 || opt.think_ns > 0)
+        work_calibrate();
+
     // Start threads with given options
     start_threads(opt);
 
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "options.h"
+#include "trace.h"
 
 // Define long and short command-line options
 static struct option long_options[] = {
@@ -22,6 +23,42 @@ static struct option long_options[] = {
       .has_arg = required_argument,
       .flag = NULL,
       .val = 'd'},
+    { .name = "work-ns",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'W'},
+    { .name = "think-ns",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'k'},
+    { .name = "lock",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'l'},
+    { .name = "policy",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'p'},
+    { .name = "lock_timeout",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'L'},
+    { .name = "upgrade",
+      .has_arg = no_argument,
+      .flag = NULL,
+      .val = 'u'},
+    { .name = "trace",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'T'},
+    { .name = "trace_file",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'o'},
+    { .name = "pin",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'P'},
     { .name = "help",
       .has_arg = no_argument,
       .flag = NULL,
@@ -39,6 +76,18 @@ static void usage(int i)
            "  -w n, --writers=<n>    Number of writer threads\n"
            "  -i n, --iterations=<n> Number of iterations per thread\n"
            "  -d n, --delay=<n>      Delay between operations (in µs)\n"
+           "  -W n, --work-ns=<n>    Busy work inside the critical section (in ns)\n"
+           "  -k n, --think-ns=<n>   Busy work between operations (in ns)\n"
+           "  -l l, --lock=<l>       What protects the counter: rw_mutex (default), seqlock or rcu\n"
+           "  -p l, --policy=<l>     Comma separated rw_mutex policies, one run each: reader (default),\n"
+           "                         writer, phase-fair, bravo or all\n"
+           "  -L n, --lock_timeout=<n> Give up an operation when the lock takes longer than this (in µs, 0: wait forever,\n"
+           "                         rw_mutex only)\n"
+           "  -u, --upgrade          Writers read the counter with an upgradeable lock, upgrade it to write\n"
+           "                         and downgrade it to check the write (rw_mutex only, no --lock_timeout)\n"
+           "  -T m, --trace=<m>: trace log: off, text (default) or binary\n"
+           "  -o f, --trace_file=<f>: trace output (default: stdout, or trace.bin when binary)\n"
+           "  -P p, --pin=<p>: pin threads: none (default), compact, scatter or a cpu list (0-3,8)\n"
            "  -h, --help             Show this message\n\n"
     );
     exit(i);
@@ -53,6 +102,25 @@ static int get_int(char *arg, int *value)
     return (end != NULL);
 }
 
+// Parse a comma separated list of policy names. Returns the number of policies, or -1
+static int get_policy_list(char *arg, int *policies)
+{
+    char *name;
+    int n = 0;
+
+    if (strcmp(arg, "all") == 0) {
+        for (n = 0; n < NUM_RW_POLICIES; n++)
+            policies[n] = n;
+        return n;
+    }
+    for (name = strtok(arg, ","); name != NULL; name = strtok(NULL, ",")) {
+        if (n == NUM_RW_POLICIES || (policies[n] = rw_policy_parse(name)) < 0)
+            return -1;
+        n++;
+    }
+    return n;
+}
+
 // Handle command-line arguments
 int handle_options(int argc, char **argv, struct options *opt)
 {
@@ -60,7 +128,7 @@ int handle_options(int argc, char **argv, struct options *opt)
         int c;
         int option_index = 0;
 
-        c = getopt_long (argc, argv, "r:w:i:d:h",
+        c = getopt_long (argc, argv, "r:w:i:d:W:k:l:p:L:uhT:o:P:",
                  long_options, &option_index);
         if (c == -1)
             break;
@@ -95,13 +163,82 @@ int handle_options(int argc, char **argv, struct options *opt)
 
         case 'd':
             if (!get_int(optarg, &opt->delay)
-                || opt->delay <= 0) {
+                || opt->delay < 0) {
+                printf("'%s': is not a valid integer\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'W':
+            if (!get_int(optarg, &opt->work_ns)
+                || opt->work_ns < 0) {
+                printf("'%s': is not a valid integer\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'k':
+            if (!get_int(optarg, &opt->think_ns)
+                || opt->think_ns < 0) {
                 printf("'%s': is not a valid integer\n",
                        optarg);
                 usage(-3);
             }
             break;
 
+        case 'l':
+            if (strcmp(optarg, "rw_mutex") == 0) {
+                opt->lock = LOCK_RW_MUTEX;
+            } else if (strcmp(optarg, "seqlock") == 0) {
+                opt->lock = LOCK_SEQLOCK;
+            } else if (strcmp(optarg, "rcu") == 0) {
+                opt->lock = LOCK_RCU;
+            } else {
+                printf("'%s': is not a valid lock\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'p':
+            if ((opt->num_policies = get_policy_list(optarg, opt->policies)) <= 0) {
+                printf("'%s': is not a valid list of policies\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'L':
+            if (!get_int(optarg, &opt->lock_timeout)
+                || opt->lock_timeout < 0) {
+                printf("'%s': is not a valid integer\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'u':
+            opt->upgrade = 1;
+            break;
+
+        case 'T':
+            if ((opt->trace = trace_parse_mode(optarg)) < 0) {
+                printf("'%s': is not a valid trace mode\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'o':
+            opt->trace_file = optarg;
+            break;
+
+        case 'P':
+            opt->pin = optarg;
+            break;
+
         case '?':
         case 'h':
             usage(0);
@@ -131,5 +268,15 @@ int read_options(int argc, char **argv, struct options *opt) {
         usage(-2);
     }
 
+    // Only the rw_mutex has timed locks and upgrades, and upgrades are not timed
+    if (opt->lock != LOCK_RW_MUTEX && (opt->lock_timeout > 0 || opt->upgrade)) {
+        printf("--lock_timeout and --upgrade only work with --lock=rw_mutex\n");
+        usage(-3);
+    }
+    if (opt->upgrade && opt->lock_timeout > 0) {
+        printf("--upgrade can not be used with --lock_timeout\n");
+        usage(-3);
+    }
+
     return 0;
 }
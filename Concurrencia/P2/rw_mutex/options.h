@@ -1,12 +1,31 @@
 #ifndef __OPTIONS_H__
 #define __OPTIONS_H__
 
+#include "rw_mutex.h"
+
+// What protects the shared counter
+enum lock_kind {
+    LOCK_RW_MUTEX,     // rw_mutex, with the policies in policies[]
+    LOCK_SEQLOCK,      // seqlock: readers copy the counter without writing anything shared
+    LOCK_RCU,          // rcu: writers publish a new copy of the state, readers never wait
+};
+
 // Structure to store command-line options
 struct options {
     int num_readers;   // Number of reader threads
     int num_writers;   // Number of writer threads
     int iterations;    // Number of iterations per thread
     int delay;         // Delay in microseconds
+    int work_ns;       // Busy work inside the critical section (in ns)
+    int think_ns;      // Busy work between operations (in ns)
+    int lock;          // enum lock_kind
+    int policies[NUM_RW_POLICIES];  // enum rw_policy of each run
+    int num_policies;
+    int lock_timeout;  // Give up an operation when the lock takes longer than this (in µs, 0: wait forever)
+    int upgrade;       // Writers read first with an upgradeable lock and then upgrade it (rw_mutex only)
+	int trace;           // enum trace_mode
+	char *trace_file;    // trace output (NULL: default for the mode)
+	char *pin;           // thread placement: none, compact, scatter or a CPU list
 };
 
 // Function to parse command-line arguments
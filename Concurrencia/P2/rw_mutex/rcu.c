@@ -0,0 +1,146 @@
+#include "rcu.h"
+#include <sched.h>
+#include <stdalign.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * A reader stores the global epoch it starts in to its slot, and 0 when it leaves. A grace period
+ * increments the epoch and waits for every slot that holds an older one: a reader that stored the
+ * new epoch (or a larger one) started after the increment, and so after the old version was
+ * unpublished. The seq_cst fence after the slot store pairs with the one after the increment, so
+ * either the writer sees the reader in its slot or the reader sees the new version.
+ */
+
+struct rcu_slot {
+    alignas(64) atomic_ulong epoch;     // Epoch the thread is reading in, 0 if none
+    int nesting;                        // Read sections of the thread open at once, only used by it
+};
+
+static atomic_int slot_used[RCU_MAX_THREADS];   // Slot index owned by a live thread, shared by every rcu_t
+static __thread int self_slot = -1;             // Slot of the calling thread
+static pthread_key_t slot_key;                  // Gives the slot back when the thread exits
+static pthread_once_t slot_key_once = PTHREAD_ONCE_INIT;
+
+static void release_slot(void *slot) {
+    atomic_store(&slot_used[(long) slot - 1], 0);
+}
+
+static void create_slot_key(void) {
+    pthread_key_create(&slot_key, release_slot);
+}
+
+// Slot of the calling thread, -1 if all of them are taken
+static int thread_slot(void) {
+    if (self_slot >= 0) {
+        return self_slot;
+    }
+    pthread_once(&slot_key_once, create_slot_key);
+    for (int i = 0; i < RCU_MAX_THREADS; i++) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&slot_used[i], &expected, 1)) {
+            self_slot = i;
+            pthread_setspecific(slot_key, (void *) (long) (i + 1));     // Non NULL, so the destructor runs
+            return i;
+        }
+    }
+    return -1;
+}
+
+int rcu_init(rcu_t *r) {
+    if (r == NULL) {
+        return -1;
+    }
+    r->slots = aligned_alloc(alignof(struct rcu_slot), RCU_MAX_THREADS * sizeof(struct rcu_slot));
+    if (r->slots == NULL) {
+        return -1;
+    }
+    if (pthread_mutex_init(&r->writers, NULL) != 0) {
+        free(r->slots);
+        return -1;
+    }
+    for (int i = 0; i < RCU_MAX_THREADS; i++) {
+        atomic_init(&r->slots[i].epoch, 0);
+        r->slots[i].nesting = 0;
+    }
+    atomic_init(&r->epoch, 1);
+    r->num_deferred = 0;
+    return 0;
+}
+
+int rcu_destroy(rcu_t *r) {
+    if (r == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < r->num_deferred; i++) {
+        r->deferred[i].free_fn(r->deferred[i].ptr);
+    }
+    r->num_deferred = 0;
+    free(r->slots);
+    if (pthread_mutex_destroy(&r->writers) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int rcu_read_lock(rcu_t *r) {
+    int i = thread_slot();
+
+    if (i < 0) {
+        return -1;
+    }
+    struct rcu_slot *slot = &r->slots[i];
+    if (slot->nesting++ == 0) {
+        atomic_store_explicit(&slot->epoch, atomic_load(&r->epoch), memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+    }
+    return 0;
+}
+
+void rcu_read_unlock(rcu_t *r) {
+    struct rcu_slot *slot = &r->slots[self_slot];
+
+    if (--slot->nesting == 0) {
+        atomic_store_explicit(&slot->epoch, 0, memory_order_release);
+    }
+}
+
+void rcu_synchronize(rcu_t *r) {
+    pthread_mutex_lock(&r->writers);
+
+    unsigned long epoch = atomic_fetch_add(&r->epoch, 1) + 1;
+    atomic_thread_fence(memory_order_seq_cst);
+
+    for (int i = 0; i < RCU_MAX_THREADS; i++) {
+        unsigned long e;
+        while ((e = atomic_load_explicit(&r->slots[i].epoch, memory_order_acquire)) != 0 && e < epoch) {
+            sched_yield();
+        }
+    }
+
+    pthread_mutex_unlock(&r->writers);
+}
+
+void rcu_defer_free(rcu_t *r, void *ptr, void (*free_fn)(void *)) {
+    struct rcu_deferred batch[RCU_DEFER_BATCH];
+    int n = 0;
+
+    pthread_mutex_lock(&r->writers);
+    r->deferred[r->num_deferred].ptr = ptr;
+    r->deferred[r->num_deferred].free_fn = free_fn;
+    if (++r->num_deferred == RCU_DEFER_BATCH) {
+        // Take the whole batch, so the grace period is paid once for all of it
+        for (n = 0; n < RCU_DEFER_BATCH; n++) {
+            batch[n] = r->deferred[n];
+        }
+        r->num_deferred = 0;
+    }
+    pthread_mutex_unlock(&r->writers);
+
+    if (n > 0) {
+        rcu_synchronize(r);
+        for (int i = 0; i < n; i++) {
+            batch[i].free_fn(batch[i].ptr);
+        }
+    }
+}
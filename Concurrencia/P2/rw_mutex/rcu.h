@@ -0,0 +1,48 @@
+#ifndef __RCU_H__
+#define __RCU_H__
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+ * rcu.c and rcu.h:
+ * Epoch-based read-copy-update. Readers of data published through an atomic
+ * pointer bracket their accesses with rcu_read_lock/unlock, which never block
+ * and only write a slot of the calling thread. Writers build a new version,
+ * publish it with an atomic store (release), and hand the old one to
+ * rcu_defer_free, which frees it after a grace period: once every reader
+ * that could still see it has left its read section. rcu_synchronize waits
+ * for one grace period, so it must not be called inside a read section.
+ * Readers load the pointer with memory_order_acquire.
+ */
+
+#define RCU_MAX_THREADS 256     // Threads that can be reading at the same time
+#define RCU_DEFER_BATCH 64      // Versions waiting to be freed before a writer frees them all
+
+struct rcu_slot;
+
+struct rcu_deferred {
+    void *ptr;
+    void (*free_fn)(void *);
+};
+
+typedef struct rcu_t {
+    atomic_ulong epoch;                 // Grace periods started, plus one
+    struct rcu_slot *slots;             // Epoch each thread is reading in, 0 if none (RCU_MAX_THREADS)
+    pthread_mutex_t writers;            // Serializes the grace periods and protects deferred
+    struct rcu_deferred deferred[RCU_DEFER_BATCH];
+    int num_deferred;
+} rcu_t;
+
+int rcu_init(rcu_t *r);
+int rcu_destroy(rcu_t *r);      // Frees the deferred versions. No thread may be reading
+
+int rcu_read_lock(rcu_t *r);    // -1 if more than RCU_MAX_THREADS threads use rcu at once
+void rcu_read_unlock(rcu_t *r);
+
+void rcu_synchronize(rcu_t *r);
+
+// Call free_fn(ptr) after a grace period. Versions are freed in batches of RCU_DEFER_BATCH
+void rcu_defer_free(rcu_t *r, void *ptr, void (*free_fn)(void *));
+
+#endif
@@ -1,31 +1,158 @@
 #include "rw_mutex.h"
+#include <stdalign.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <sched.h>
+#include <string.h>
 
+/*
+ * Reader-biased policy (BRAVO, D. Dice and A. Kogan, "BRAVO: Biased Locking for Reader-Writer Locks").
+ * Each thread gets one of RW_SLOTS counters of the lock, each on its own cache line. While rbias is on a
+ * reader increments its counter and checks rbias again, so readers of different threads write nothing in
+ * common. A writer first takes the lock as usual, which keeps out the slow path readers, then turns rbias
+ * off and waits for every counter to be 0: a reader either saw rbias off and went to the slow path, or is
+ * counted and will leave. A revocation that took t keeps the bias off for RW_INHIBIT_FACTOR * t, so writers
+ * do not pay for it on every write, and the next slow path reader after that turns it on again.
+ */
 
-int rw_mutex_init(rw_mutex_t *m){
-    if (m == NULL) {
+#define RW_SLOTS 64
+#define RW_INHIBIT_FACTOR 9
+#define RW_MAX_FAST_HELD 8  // Fast path read locks a thread can hold at once, more take the slow path
+
+struct rw_slot {
+    alignas(64) atomic_int readers;
+};
+
+static const struct timespec no_wait;              // Deadline that has always passed, for the try locks
+
+static atomic_int next_slot;                        // Slot of the next thread that reads a reader-biased lock
+static __thread int self_slot = -1;                 // Slot of the calling thread
+static __thread rw_mutex_t *fast_held[RW_MAX_FAST_HELD];  // Locks read by the calling thread on the fast path
+static __thread int num_fast_held;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static struct rw_slot *thread_slot(rw_mutex_t *m) {
+    if (self_slot < 0) {
+        self_slot = atomic_fetch_add_explicit(&next_slot, 1, memory_order_relaxed) % RW_SLOTS;
+    }
+    return &m->slots[self_slot];
+}
+
+// Fast path of a reader-biased lock, 0 if the read lock was taken
+static int read_fast(rw_mutex_t *m) {
+    if (num_fast_held == RW_MAX_FAST_HELD || !atomic_load_explicit(&m->rbias, memory_order_relaxed)) {
+        return -1;
+    }
+    struct rw_slot *slot = thread_slot(m);
+    atomic_fetch_add(&slot->readers, 1);
+    if (atomic_load(&m->rbias)) {       // Pairs with the writer turning rbias off and then reading the slots
+        fast_held[num_fast_held++] = m;
+        return 0;
+    }
+    atomic_fetch_sub_explicit(&slot->readers, 1, memory_order_release);
+    return -1;
+}
+
+// Release a fast path read lock of m, -1 if the thread holds none
+static int read_fast_unlock(rw_mutex_t *m) {
+    for (int i = num_fast_held - 1; i >= 0; i--) {
+        if (fast_held[i] == m) {
+            fast_held[i] = fast_held[--num_fast_held];
+            atomic_fetch_sub_explicit(&thread_slot(m)->readers, 1, memory_order_release);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Wait until no reader is in the fast path, -1 if the deadline (if any) passes first
+static int drain_slots(rw_mutex_t *m, const struct timespec *deadline) {
+    for (int i = 0; i < RW_SLOTS; i++) {
+        while (atomic_load(&m->slots[i].readers) != 0) {
+            if (deadline != NULL) {
+                struct timespec now;
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                if (now.tv_sec > deadline->tv_sec
+                    || (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec)) {
+                    return -1;
+                }
+            }
+            sched_yield();
+        }
+    }
+    return 0;
+}
+
+
+int rw_mutex_init_policy(rw_mutex_t *m, int policy){
+    if (m == NULL || policy < 0 || policy >= NUM_RW_POLICIES) {
         return -1;
     }
     if (pthread_mutex_init(&m->m, NULL) != 0) {
         return -1;
     }
-    if (pthread_cond_init(&m->readers, NULL) != 0) {
+    // The timed locks take CLOCK_MONOTONIC deadlines, so both conditions measure time with that clock
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    if (pthread_cond_init(&m->readers, &attr) != 0) {
+        pthread_condattr_destroy(&attr);
+        pthread_mutex_destroy(&m->m);
+        return -1;
+    }
+    if (pthread_cond_init(&m->writers, &attr) != 0) {
+        pthread_condattr_destroy(&attr);
+        pthread_cond_destroy(&m->readers);
         pthread_mutex_destroy(&m->m);
         return -1;
     }
-    if (pthread_cond_init(&m->writers, NULL) != 0) {
+    if (pthread_cond_init(&m->upgraders, &attr) != 0) {
+        pthread_condattr_destroy(&attr);
+        pthread_cond_destroy(&m->writers);
         pthread_cond_destroy(&m->readers);
         pthread_mutex_destroy(&m->m);
         return -1;
     }
+    pthread_condattr_destroy(&attr);
     m->active_readers = 0;
     m->writing = 0;
+    m->policy = policy;
+    m->waiting_writers = 0;
+    m->waiting_readers = 0;
+    m->reader_turn = 0;
+    m->write_phase = 0;
+    atomic_init(&m->rbias, 0);
+    m->slots = NULL;
+    m->inhibit_until = 0;
+    m->drain_pending = 0;
+    m->upgrader = 0;
+    m->upgrading = 0;
+    if (policy == RW_READER_BIASED) {
+        m->slots = aligned_alloc(alignof(struct rw_slot), RW_SLOTS * sizeof(struct rw_slot));
+        if (m->slots == NULL) {
+            rw_mutex_destroy(m);
+            return -1;
+        }
+        for (int i = 0; i < RW_SLOTS; i++) {
+            atomic_init(&m->slots[i].readers, 0);
+        }
+        atomic_init(&m->rbias, 1);
+    }
 
     return 0;
 }
 
+int rw_mutex_init(rw_mutex_t *m) {
+    return rw_mutex_init_policy(m, RW_PREFER_READERS);
+}
+
 int rw_mutex_destroy(rw_mutex_t *m) {
     if (m == NULL) {
         return -1;
@@ -33,55 +160,220 @@ int rw_mutex_destroy(rw_mutex_t *m) {
     if (pthread_mutex_destroy(&m->m) != 0) {
         return -1;
     }
-    if (pthread_cond_destroy(&m->readers) != 0 || pthread_cond_destroy(&m->writers) != 0) {
+    if (pthread_cond_destroy(&m->readers) != 0 || pthread_cond_destroy(&m->writers) != 0
+        || pthread_cond_destroy(&m->upgraders) != 0) {
         return -1;
     }
+    free(m->slots);
+    m->slots = NULL;
 
     return 0;
 }
 
-int rw_mutex_readlock(rw_mutex_t *m) {
-    if (m == NULL) {
-        return -1;
+// Wait on c with m->m held, until the deadline if there is one. Returns ETIMEDOUT once it has passed
+static int wait_until(pthread_cond_t *c, rw_mutex_t *m, const struct timespec *deadline) {
+    if (deadline == NULL) {
+        return pthread_cond_wait(c, &m->m);
     }
-    pthread_mutex_lock(&m->m);
+    return pthread_cond_timedwait(c, &m->m, deadline);
+}
+
+// Phase-fair: let in every reader waiting for the write phase, writers go again once they have entered
+static void end_write_phase(rw_mutex_t *m) {
+    m->write_phase++;
+    m->reader_turn = m->waiting_readers;
+    if (m->reader_turn > 0) {
+        pthread_cond_broadcast(&m->readers);
+    } else {
+        pthread_cond_signal(&m->writers);
+    }
+}
 
-    // A reader must wait if there is an active writer
-    while (m->writing) {
-        pthread_cond_wait(&m->readers, &m->m);
+// A new reader must wait if there is an active writer, an upgrade going on, or a waiting writer when writers
+// are preferred. Under phase-fair any waiting writer holds it back until the end of the next write phase
+static int reader_must_wait(rw_mutex_t *m) {
+    if (m->writing || m->upgrading) {
+        return 1;
     }
+    return (m->policy == RW_PREFER_WRITERS || m->policy == RW_PHASE_FAIR) && m->waiting_writers > 0;
+}
+
+// Count a slow path reader in, with m->m held
+static void read_enter(rw_mutex_t *m) {
     m->active_readers++;
 
+    // Turn the bias back on once the last revocation has been paid for
+    if (m->policy == RW_READER_BIASED && m->waiting_writers == 0
+        && !atomic_load_explicit(&m->rbias, memory_order_relaxed) && now_ns() >= m->inhibit_until) {
+        atomic_store(&m->rbias, 1);
+    }
+}
+
+// Give up a read lock that timed out, with m->m held
+static int read_give_up(rw_mutex_t *m, int upgradeable) {
+    if (upgradeable) {
+        m->upgrader = 0;
+        pthread_cond_broadcast(&m->upgraders);
+    }
+    pthread_mutex_unlock(&m->m);
+    return -1;
+}
+
+static int read_acquire(rw_mutex_t *m, const struct timespec *deadline, int upgradeable) {
+    // The upgradeable reader must be counted in active_readers, so it never takes the fast path
+    if (!upgradeable && m->policy == RW_READER_BIASED && read_fast(m) == 0) {
+        return 0;
+    }
+    pthread_mutex_lock(&m->m);
+
+    if (upgradeable) {
+        while (m->upgrader) {
+            if (wait_until(&m->upgraders, m, deadline) == ETIMEDOUT && m->upgrader) {
+                pthread_mutex_unlock(&m->m);
+                return -1;
+            }
+        }
+        m->upgrader = 1;
+    }
+
+    if (m->policy == RW_PHASE_FAIR) {
+        // Wait for the current or next write to finish, instead of for the writers to run out
+        if (reader_must_wait(m)) {
+            unsigned phase = m->write_phase;
+            m->waiting_readers++;
+            while (m->write_phase == phase) {
+                // A write phase may have ended right at the deadline, so look again before giving up
+                if (wait_until(&m->readers, m, deadline) == ETIMEDOUT && m->write_phase == phase) {
+                    m->waiting_readers--;
+                    return read_give_up(m, upgradeable);
+                }
+            }
+            m->waiting_readers--;
+            m->reader_turn--;
+        }
+    } else {
+        while (reader_must_wait(m)) {
+            if (wait_until(&m->readers, m, deadline) == ETIMEDOUT && reader_must_wait(m)) {
+                return read_give_up(m, upgradeable);
+            }
+        }
+    }
+    read_enter(m);
+
     pthread_mutex_unlock(&m->m);
     return 0;
 }
 
-int rw_mutex_writelock(rw_mutex_t *m) {
-    if (m == NULL) {
-        return -1;
+// Release the write lock and wake who goes next, with m->m held
+static void write_release(rw_mutex_t *m) {
+    m->writing = 0;
+
+    switch (m->policy) {
+    case RW_PREFER_WRITERS:
+        // Readers only go when no writer is left waiting
+        if (m->waiting_writers > 0) {
+            pthread_cond_signal(&m->writers);
+        } else {
+            pthread_cond_broadcast(&m->readers);
+        }
+        break;
+
+    case RW_PHASE_FAIR:
+        end_write_phase(m);
+        break;
+
+    default:
+        // Prioritize waiting writers, but if none, wake up all readers
+        pthread_cond_signal(&m->writers);
+        pthread_cond_broadcast(&m->readers);
     }
+}
+
+static int write_acquire(rw_mutex_t *m, const struct timespec *deadline) {
     pthread_mutex_lock(&m->m);
 
-    // A writer must wait if there are active readers or another active writer
-    while (m->writing || m->active_readers > 0) {
-        pthread_cond_wait(&m->writers, &m->m);
+    // A writer must wait if there are active readers, another active writer or readers let in by the
+    // last write phase (phase-fair)
+    m->waiting_writers++;
+    while (m->writing || m->active_readers > 0 || m->reader_turn > 0) {
+        // A timed out wait may have consumed the signal of the last unlock: if the lock is free take it,
+        // otherwise that unlock did not free it and the next one will signal again
+        if (wait_until(&m->writers, m, deadline) == ETIMEDOUT
+            && (m->writing || m->active_readers > 0 || m->reader_turn > 0)) {
+            m->waiting_writers--;
+            // Readers held back by this writer must not wait for a write that will not happen
+            if (m->waiting_writers == 0 && !m->writing) {
+                if (m->policy == RW_PREFER_WRITERS) {
+                    pthread_cond_broadcast(&m->readers);
+                } else if (m->policy == RW_PHASE_FAIR && m->waiting_readers > 0) {
+                    end_write_phase(m);
+                }
+            }
+            pthread_mutex_unlock(&m->m);
+            return -1;
+        }
     }
+    m->waiting_writers--;
     m->writing = 1;
+    int pending = m->drain_pending;
+    m->drain_pending = 0;
 
     pthread_mutex_unlock(&m->m);
 
+    // Reader-biased: the slow path readers are out, now revoke the bias and wait for the fast path ones.
+    // With the bias already off the slots are empty, unless the last writer gave up before they drained.
+    // No reader can turn the bias on while writing is set, so a relaxed load is enough to skip all of it
+    if (m->policy == RW_READER_BIASED
+        && (pending || atomic_load_explicit(&m->rbias, memory_order_relaxed))) {
+        uint64_t start = now_ns();
+        int revoked = atomic_exchange(&m->rbias, 0);
+        int drained = drain_slots(m, deadline);
+
+        pthread_mutex_lock(&m->m);
+        if (revoked) {
+            uint64_t end = now_ns();
+            m->inhibit_until = end + (end - start) * RW_INHIBIT_FACTOR;
+        }
+        if (drained != 0) {
+            m->drain_pending = 1;
+            write_release(m);
+            pthread_mutex_unlock(&m->m);
+            return -1;
+        }
+        pthread_mutex_unlock(&m->m);
+    }
     return 0;
 }
 
+int rw_mutex_readlock(rw_mutex_t *m) {
+    if (m == NULL) {
+        return -1;
+    }
+    return read_acquire(m, NULL, 0);
+}
+
+int rw_mutex_writelock(rw_mutex_t *m) {
+    if (m == NULL) {
+        return -1;
+    }
+    return write_acquire(m, NULL);
+}
+
 int rw_mutex_readunlock(rw_mutex_t *m) {
     if (m == NULL) {
         return -1;
     }
+    if (m->policy == RW_READER_BIASED && read_fast_unlock(m) == 0) {
+        return 0;
+    }
     pthread_mutex_lock(&m->m);
     m->active_readers--;
     if (m->active_readers == 0) {
         // If no more readers, wake up a writer if waiting
         pthread_cond_signal(&m->writers);
+    } else if (m->active_readers == 1 && m->upgrading) {
+        // Only the upgradeable reader is left
+        pthread_cond_broadcast(&m->upgraders);
     }
     pthread_mutex_unlock(&m->m);
     return 0;
@@ -92,12 +384,172 @@ int rw_mutex_writeunlock(rw_mutex_t *m) {
         return -1;
     }
     pthread_mutex_lock(&m->m);
-    m->writing = 0;
+    write_release(m);
+    pthread_mutex_unlock(&m->m);
+    return 0;
+}
+
+int rw_mutex_timedreadlock(rw_mutex_t *m, const struct timespec *deadline) {
+    if (m == NULL || deadline == NULL) {
+        return -1;
+    }
+    return read_acquire(m, deadline, 0);
+}
+
+int rw_mutex_timedwritelock(rw_mutex_t *m, const struct timespec *deadline) {
+    if (m == NULL || deadline == NULL) {
+        return -1;
+    }
+    return write_acquire(m, deadline);
+}
+
+int rw_mutex_tryreadlock(rw_mutex_t *m) {
+    if (m == NULL) {
+        return -1;
+    }
+    if (m->policy == RW_READER_BIASED && read_fast(m) == 0) {
+        return 0;
+    }
+    pthread_mutex_lock(&m->m);
+    if (reader_must_wait(m)) {
+        pthread_mutex_unlock(&m->m);
+        return -1;
+    }
+    read_enter(m);
+    pthread_mutex_unlock(&m->m);
+    return 0;
+}
+
+int rw_mutex_trywritelock(rw_mutex_t *m) {
+    if (m == NULL) {
+        return -1;
+    }
+    pthread_mutex_lock(&m->m);
+    if (m->writing || m->active_readers > 0 || m->reader_turn > 0) {
+        pthread_mutex_unlock(&m->m);
+        return -1;
+    }
+    m->writing = 1;
+    int pending = m->drain_pending;
+    m->drain_pending = 0;
+    pthread_mutex_unlock(&m->m);
+
+    // Reader-biased: revoke the bias, and give the lock back if a fast path reader is still in
+    if (m->policy == RW_READER_BIASED
+        && (pending || atomic_load_explicit(&m->rbias, memory_order_relaxed))) {
+        atomic_store(&m->rbias, 0);
+
+        if (drain_slots(m, &no_wait) != 0) {
+            pthread_mutex_lock(&m->m);
+            m->drain_pending = 1;
+            write_release(m);
+            pthread_mutex_unlock(&m->m);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int rw_mutex_upgradelock(rw_mutex_t *m) {
+    if (m == NULL) {
+        return -1;
+    }
+    return read_acquire(m, NULL, 1);
+}
+
+int rw_mutex_upgradeunlock(rw_mutex_t *m) {
+    if (m == NULL) {
+        return -1;
+    }
+    pthread_mutex_lock(&m->m);
+    m->active_readers--;
+    m->upgrader = 0;
+    if (m->active_readers == 0) {
+        pthread_cond_signal(&m->writers);
+    }
+    pthread_cond_broadcast(&m->upgraders);
+    pthread_mutex_unlock(&m->m);
+    return 0;
+}
 
-    // Prioritize waiting writers, but if none, wake up all readers
-    pthread_cond_signal(&m->writers);
-    pthread_cond_broadcast(&m->readers);
+// The upgradeable reader holds back the new readers and waits for the others, no writer can get in meanwhile
+// because it is still counted as a reader. Only one thread can be upgrading, so two upgrades never wait for
+// each other
+int rw_mutex_upgrade(rw_mutex_t *m) {
+    if (m == NULL) {
+        return -1;
+    }
+    pthread_mutex_lock(&m->m);
+    if (!m->upgrader) {
+        pthread_mutex_unlock(&m->m);
+        return -1;
+    }
+    m->upgrading = 1;
+
+    // Reader-biased: revoke the bias first, so the readers that come meanwhile go to the slow path and wait
+    uint64_t start = now_ns();
+    int revoked = m->policy == RW_READER_BIASED && atomic_exchange(&m->rbias, 0);
 
+    while (m->active_readers > 1 || m->reader_turn > 0) {
+        pthread_cond_wait(&m->upgraders, &m->m);
+    }
+    m->active_readers--;
+    m->upgrading = 0;
+    m->upgrader = 0;
+    m->writing = 1;
+    int pending = m->drain_pending;
+    m->drain_pending = 0;
+    pthread_cond_broadcast(&m->upgraders);
+    pthread_mutex_unlock(&m->m);
+
+    if (revoked || pending) {
+        drain_slots(m, NULL);
+        if (revoked) {
+            pthread_mutex_lock(&m->m);
+            uint64_t end = now_ns();
+            m->inhibit_until = end + (end - start) * RW_INHIBIT_FACTOR;
+            pthread_mutex_unlock(&m->m);
+        }
+    }
+    return 0;
+}
+
+// The caller stays as a reader and the lock is released as after a write, so the readers waiting for it
+// come in with the caller
+int rw_mutex_downgrade(rw_mutex_t *m) {
+    if (m == NULL) {
+        return -1;
+    }
+    pthread_mutex_lock(&m->m);
+    if (!m->writing) {
+        pthread_mutex_unlock(&m->m);
+        return -1;
+    }
+    m->active_readers++;
+    write_release(m);
     pthread_mutex_unlock(&m->m);
     return 0;
 }
+
+static const char *policy_names[NUM_RW_POLICIES] = {
+    [RW_PREFER_READERS] = "reader",
+    [RW_PREFER_WRITERS] = "writer",
+    [RW_PHASE_FAIR]     = "phase-fair",
+    [RW_READER_BIASED]  = "bravo",
+};
+
+const char *rw_policy_name(int policy) {
+    if (policy < 0 || policy >= NUM_RW_POLICIES) {
+        return "?";
+    }
+    return policy_names[policy];
+}
+
+int rw_policy_parse(const char *name) {
+    for (int policy = 0; policy < NUM_RW_POLICIES; policy++) {
+        if (strcmp(name, policy_names[policy]) == 0) {
+            return policy;
+        }
+    }
+    return -1;
+}
@@ -2,16 +2,43 @@
 #define __RW_MUTEX_H__
 
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+
+// Who goes first when readers and writers are waiting
+enum rw_policy {
+    RW_PREFER_READERS,  // Readers only wait for an active writer, so a stream of readers can starve the writers
+    RW_PREFER_WRITERS,  // Readers also wait while a writer is waiting, so a stream of writers can starve the readers
+    RW_PHASE_FAIR,      // Read and write phases alternate: the readers that arrive while a writer is active or
+                        // waiting go right after that writer, before the next one
+    RW_READER_BIASED,   // BRAVO: while the bias is on, readers only mark a slot of their own in the lock, and a
+                        // writer turns the bias off and waits for the slots to drain. Otherwise as RW_PREFER_READERS
+    NUM_RW_POLICIES
+};
 
 typedef struct rw_mutex_t {
     pthread_mutex_t m;      // Protect the access to the internal variables
     pthread_cond_t readers; // Condition to wake up readers
     pthread_cond_t writers; // Condition to wake up writers
+    pthread_cond_t upgraders; // Condition to wake up the upgradeable reader, or those waiting to be it
     int active_readers;     // Number of active readers
     int writing;     // If there is active writers (0/1)
+    int policy;             // enum rw_policy
+    int waiting_writers;    // Writers blocked in writelock
+    int waiting_readers;    // Readers blocked in readlock waiting for a write phase to end (phase-fair)
+    int reader_turn;        // Readers let in by the last write phase that have not entered yet (phase-fair)
+    unsigned write_phase;   // Number of write phases ended (phase-fair)
+    atomic_int rbias;       // Readers may take the fast path (reader-biased)
+    struct rw_slot *slots;  // Fast path readers of each thread slot (reader-biased, NULL otherwise)
+    uint64_t inhibit_until; // Time before which the bias is not turned on again, after a costly revocation (in ns)
+    int drain_pending;      // A writer gave up before the slots drained (reader-biased)
+    int upgrader;           // An upgradeable read lock is held or being waited for (0/1)
+    int upgrading;          // The upgradeable reader waits for the other readers to leave (0/1)
 } rw_mutex_t;
 
-int rw_mutex_init(rw_mutex_t *m);
+int rw_mutex_init(rw_mutex_t *m);   // Prefer readers
+int rw_mutex_init_policy(rw_mutex_t *m, int policy);
 int rw_mutex_destroy(rw_mutex_t *m);
 
 int rw_mutex_readlock(rw_mutex_t *m);
@@ -19,4 +46,23 @@ int rw_mutex_writelock(rw_mutex_t *m);
 int rw_mutex_readunlock(rw_mutex_t *m);
 int rw_mutex_writeunlock(rw_mutex_t *m);
 
-#endif
\ No newline at end of file
+// Same as readlock/writelock, but give up with -1 once the absolute CLOCK_MONOTONIC deadline has passed
+int rw_mutex_timedreadlock(rw_mutex_t *m, const struct timespec *deadline);
+int rw_mutex_timedwritelock(rw_mutex_t *m, const struct timespec *deadline);
+
+// Take the lock only if that needs no waiting, -1 otherwise
+int rw_mutex_tryreadlock(rw_mutex_t *m);
+int rw_mutex_trywritelock(rw_mutex_t *m);
+
+// Upgradeable read lock: shared with readers but not with writers or another upgradeable reader, so it can
+// become a write lock without letting anyone write in between. Released with upgradeunlock, or with upgrade
+// and then writeunlock
+int rw_mutex_upgradelock(rw_mutex_t *m);
+int rw_mutex_upgradeunlock(rw_mutex_t *m);
+int rw_mutex_upgrade(rw_mutex_t *m);    // Wait for the other readers to leave and keep the lock for writing
+int rw_mutex_downgrade(rw_mutex_t *m);  // Turn a write lock into a read lock, released with readunlock
+
+const char *rw_policy_name(int policy);
+int rw_policy_parse(const char *name);  // -1 if it is not a policy
+
+#endif
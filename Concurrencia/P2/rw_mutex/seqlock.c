@@ -0,0 +1,61 @@
+#include "seqlock.h"
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SPINS_BEFORE_YIELD 64   // A reader waiting for a writer gives up the CPU after this many checks
+
+int seqlock_init(seqlock_t *s) {
+    if (s == NULL) {
+        return -1;
+    }
+    if (pthread_mutex_init(&s->writers, NULL) != 0) {
+        return -1;
+    }
+    atomic_init(&s->seq, 0);
+    return 0;
+}
+
+int seqlock_destroy(seqlock_t *s) {
+    if (s == NULL) {
+        return -1;
+    }
+    if (pthread_mutex_destroy(&s->writers) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+void seq_write_begin(seqlock_t *s) {
+    pthread_mutex_lock(&s->writers);
+    unsigned seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+    atomic_store_explicit(&s->seq, seq + 1, memory_order_relaxed);
+    // The odd number has to be visible before any store to the data
+    atomic_thread_fence(memory_order_release);
+}
+
+void seq_write_end(seqlock_t *s) {
+    unsigned seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+    atomic_store_explicit(&s->seq, seq + 1, memory_order_release);
+    pthread_mutex_unlock(&s->writers);
+}
+
+unsigned seq_read_begin(seqlock_t *s) {
+    unsigned seq;
+    int spins = 0;
+
+    // Wait for the writer to finish, there is no point copying data that is being changed
+    while ((seq = atomic_load_explicit(&s->seq, memory_order_acquire)) & 1) {
+        if (++spins == SPINS_BEFORE_YIELD) {
+            sched_yield();
+            spins = 0;
+        }
+    }
+    return seq;
+}
+
+int seq_read_retry(seqlock_t *s, unsigned start) {
+    // The loads of the data have to be done before reading the sequence number again
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&s->seq, memory_order_relaxed) != start;
+}
@@ -0,0 +1,32 @@
+#ifndef __SEQLOCK_H__
+#define __SEQLOCK_H__
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+ * seqlock.c and seqlock.h:
+ * Sequence lock for small data that is read much more often than written.
+ * Writers exclude each other with a mutex and make the sequence number odd
+ * while they change the data. Readers take no lock and write nothing shared:
+ * they copy the data and start again if the sequence number was odd or
+ * changed meanwhile. The protected data must be read and written with
+ * (relaxed) atomics, since readers may see it in the middle of a write.
+ */
+
+typedef struct seqlock_t {
+    atomic_uint seq;            // Odd while a writer is changing the data
+    pthread_mutex_t writers;    // Serializes the writers
+} seqlock_t;
+
+int seqlock_init(seqlock_t *s);
+int seqlock_destroy(seqlock_t *s);
+
+void seq_write_begin(seqlock_t *s);
+void seq_write_end(seqlock_t *s);
+
+// Read side: do { start = seq_read_begin(s); copy the data } while (seq_read_retry(s, start));
+unsigned seq_read_begin(seqlock_t *s);
+int seq_read_retry(seqlock_t *s, unsigned start);   // 1 if the copy may be torn and has to be made again
+
+#endif
@@ -1,10 +1,14 @@
 #include <errno.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <time.h>
 #include "options.h"
+#include "affinity.h"
 #include "sem.h"
+#include "trace.h"
 
 // Structure representing a shared buffer
 struct buffer {
@@ -13,6 +17,9 @@ struct buffer {
     sem_t free_seats_sem;    //Sem that acts like a mutex to protect free_seats
     int free_seats;
     int done;                //No more clients expected
+    atomic_int served;       //Customers that got a hair cut
+    atomic_int no_seats;     //Customers that found every seat taken
+    atomic_int gave_up;      //Customers that left the seat before a barber was free
 };
 
 // Structure representing thread information
@@ -25,9 +32,21 @@ struct thread_info {
 struct args {
     int				thread_num;       // application defined thread #
     int				delay;			  // delay between operations (only used by the barder)
+    int				patience;         // time waiting for a barber before leaving (in usecs, 0: forever)
+    int				trace_slot;       // trace ring of the thread (barbers first, then customers)
     struct buffer	*buffer;		  // Shared buffer
 };
 
+// Trace events logged by the barbers and customers
+enum { EV_CUT, EV_SERVED, EV_NO_SEATS, EV_GAVE_UP, NUM_EVENTS };
+
+static const char *trace_events[NUM_EVENTS] = {
+    [EV_CUT]      = "Barbero %d: Cortando el pelo...\n",
+    [EV_SERVED]   = "Cliente %d: Le están cortando el pelo...\n",
+    [EV_NO_SEATS] = "Cliente %d: No hay sillas, se va.\n",
+    [EV_GAVE_UP]  = "Cliente %d: Se cansa de esperar, se va.\n",
+};
+
 void *barber_thread(void *ptr) {
     struct args *args =  ptr;
     while (1) {
@@ -47,7 +66,7 @@ void *barber_thread(void *ptr) {
         sem_v(&args->buffer->free_seats_sem);   //Unlock the counter
 
         // Simulation of the hair cut
-        printf("Barbero %d: Cortando el pelo...\n", args->thread_num);
+        TRACE(args->trace_slot, EV_CUT, args->thread_num);
         usleep(args->delay);
     }
     return NULL;
@@ -55,6 +74,42 @@ void *barber_thread(void *ptr) {
 
 
 
+// Wait for a free barber for at most the customer's patience.
+// Returns 0 when a barber is going to cut the hair, -1 when the customer left the seat.
+static int wait_barber(struct args *args)
+{
+    struct timespec deadline;
+
+    if (args->patience == 0) {
+        sem_p(&args->buffer->barbers);
+        return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += args->patience / 1000000;
+    deadline.tv_nsec += (long)(args->patience % 1000000) * 1000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    if (sem_timedp(&args->buffer->barbers, &deadline) == 0) {
+        return 0;
+    }
+
+    //Take back the signal given to the barbers. If it is gone a barber already counted on this customer,
+    //so the customer has to stay until that barber signals
+    if (sem_tryp(&args->buffer->customers) != 0) {
+        sem_p(&args->buffer->barbers);
+        return 0;
+    }
+
+    sem_p(&args->buffer->free_seats_sem);
+    args->buffer->free_seats ++;                //Free the chair again
+    sem_v(&args->buffer->free_seats_sem);
+    return -1;
+}
+
 void *customer_thread(void *ptr) {
     struct args *args =  ptr;
     sem_p(&args->buffer->free_seats_sem);       //Block counter
@@ -64,14 +119,20 @@ void *customer_thread(void *ptr) {
 
         sem_v(&args->buffer->free_seats_sem);   //Unlock the counter
 
-        sem_p(&args->buffer->barbers);          //Waits for a free barber
+        if (wait_barber(args) != 0) {           //Waits for a free barber
+            atomic_fetch_add(&args->buffer->gave_up, 1);
+            TRACE(args->trace_slot, EV_GAVE_UP, args->thread_num);
+            return NULL;
+        }
 
         // Simulation of the hair cut
-        printf("Cliente %d: Le están cortando el pelo...\n", args->thread_num);
+        atomic_fetch_add(&args->buffer->served, 1);
+        TRACE(args->trace_slot, EV_SERVED, args->thread_num);
         usleep(args->delay);
     }else {
         sem_v(&args->buffer->free_seats_sem);
-        printf("Cliente %d: No hay sillas, se va.\n", args->thread_num);
+        atomic_fetch_add(&args->buffer->no_seats, 1);
+        TRACE(args->trace_slot, EV_NO_SEATS, args->thread_num);
     }
     return NULL;
 }
@@ -83,15 +144,26 @@ void start_threads(struct options opt)
     struct thread_info *customer_threads, *barber_threads;    //Pointer to an array of thread_info structures
     struct args *customer_args,*barber_args;                  //Pointer to an array of arg structures
     struct buffer buffer;                                     //Local variable that represents the shared buffer with the semaphores, the number of free seats and the flag
+    struct affinity aff;                                      //CPU of each thread: barbers first, then customers
+    pthread_attr_t attr;
 
     sem_init(&buffer.customers, 0);         //Initially there is no clients waiting
     sem_init(&buffer.barbers, 0);           //Initially the barber is sleeping
     sem_init(&buffer.free_seats_sem, 1);    //Sem that acts like a mutex to protect free_seats
     buffer.free_seats = opt.seats;
     buffer.done = 0;
+    atomic_init(&buffer.served, 0);
+    atomic_init(&buffer.no_seats, 0);
+    atomic_init(&buffer.gave_up, 0);
 
     printf("creando %d hilos de barberos y %d hilos de clientes\n", opt.barbers,opt.customers);
 
+    if (affinity_init(&aff, opt.pin) != 0) {
+        printf("'%s': is not a valid placement\n", opt.pin);
+        exit(1);
+    }
+    affinity_print(&aff, stdout, "");
+
     //Allocate memory for the info structure of each thread and its respective arguments structure,
     //There will be (customers + barbers) threads in total
     customer_threads = malloc(sizeof(struct thread_info) * opt.customers);
@@ -105,16 +177,26 @@ void start_threads(struct options opt)
         exit(1);
     }
 
+    // Start the trace flusher, with one ring per thread
+    if (trace_init(opt.trace, opt.trace_file, opt.barbers + opt.customers, trace_events, NUM_EVENTS) != 0) {
+        printf("Could not start the trace log\n");
+        exit(1);
+    }
+
     //Creation of the barber threads
     for (i = 0; i < opt.barbers; i++) {
         barber_threads[i].thread_num = i;
         barber_args[i].thread_num = i;
         barber_args[i].delay = opt.cut_time;
+        barber_args[i].patience = 0;
+        barber_args[i].trace_slot = i;
         barber_args[i].buffer = &buffer;
-        if (pthread_create(&barber_threads[i].thread_id, NULL, barber_thread, &barber_args[i]) != 0) {
+        affinity_attr(&aff, i, &attr);
+        if (pthread_create(&barber_threads[i].thread_id, &attr, barber_thread, &barber_args[i]) != 0) {
             printf("Could not create the barber thread #%d", i);
             exit(1);
         }
+        pthread_attr_destroy(&attr);
     }
 
 
@@ -123,11 +205,15 @@ void start_threads(struct options opt)
         customer_threads[i].thread_num = i;
         customer_args[i].thread_num = i;
         customer_args[i].delay = opt.cut_time;
+        customer_args[i].patience = opt.patience;
+        customer_args[i].trace_slot = opt.barbers + i;
         customer_args[i].buffer = &buffer;
-        if (pthread_create(&customer_threads[i].thread_id, NULL, customer_thread, &customer_args[i]) != 0) {
+        affinity_attr(&aff, opt.barbers + i, &attr);
+        if (pthread_create(&customer_threads[i].thread_id, &attr, customer_thread, &customer_args[i]) != 0) {
             printf("Could not create the customer thread #%d", i);
             exit(1);
         }
+        pthread_attr_destroy(&attr);
     }
 
 
@@ -148,7 +234,14 @@ void start_threads(struct options opt)
         pthread_join(barber_threads[i].thread_id, NULL);
     }
 
+    // Write out the pending trace records
+    trace_finish();
+
+    printf("atendidos: %d, sin silla: %d, se cansan de esperar: %d\n",
+           atomic_load(&buffer.served), atomic_load(&buffer.no_seats), atomic_load(&buffer.gave_up));
+
     // Liberar recursos
+    affinity_destroy(&aff);
     free(barber_threads);
     free(customer_threads);
     free(barber_args);
@@ -170,6 +263,10 @@ int main (int argc, char **argv)
     opt.customers = 100;
     opt.cut_time  = 1000;
     opt.seats = 5;
+    opt.patience = 0;
+    opt.trace = TRACE_TEXT;
+    opt.trace_file = NULL;
+    opt.pin = "none";
 
     read_options(argc, argv, &opt);
 
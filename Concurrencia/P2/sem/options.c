@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "options.h"
+#include "trace.h"
 
 static struct option long_options[] = {
     { .name = "barbers",
@@ -17,6 +18,22 @@ static struct option long_options[] = {
       .has_arg = required_argument,
       .flag = NULL,
       .val = 't'},
+    { .name = "patience",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'p'},
+    { .name = "trace",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'T'},
+    { .name = "trace_file",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'o'},
+    { .name = "pin",
+      .has_arg = required_argument,
+      .flag = NULL,
+      .val = 'P'},
     { .name = "help",
       .has_arg = no_argument,
       .flag = NULL,
@@ -32,6 +49,10 @@ static void usage(int i)
         "  -b n, --barbers=<n>: number of barber threads\n"
         "  -c n, --customers=<n>: number of customer threads\n"
         "  -t n, --cut_time=<n>: time that it takes to cut the hair\n"
+        "  -p n, --patience=<n>: time a seated customer waits for a barber before leaving (in usecs, 0: forever)\n"
+        "  -T m, --trace=<m>: trace log: off, text (default) or binary\n"
+        "  -o f, --trace_file=<f>: trace output (default: stdout, or trace.bin when binary)\n"
+        "  -P p, --pin=<p>: pin threads: none (default), compact, scatter or a cpu list (0-3,8)\n"
         "  -h, --help: this message\n\n"
     );
     exit(i);
@@ -51,7 +72,7 @@ int handle_options(int argc, char **argv, struct options *opt)
         int c;
         int option_index = 0;
 
-        c = getopt_long (argc, argv, "ht:c:b:",
+        c = getopt_long (argc, argv, "ht:c:b:p:T:o:P:",
                  long_options, &option_index);
         if (c == -1)
             break;
@@ -84,6 +105,31 @@ int handle_options(int argc, char **argv, struct options *opt)
             }
             break;
 
+        case 'p':
+            if (!get_int(optarg, &opt->patience)
+                || opt->patience < 0) {
+                printf("'%s': is not a valid integer\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'T':
+            if ((opt->trace = trace_parse_mode(optarg)) < 0) {
+                printf("'%s': is not a valid trace mode\n",
+                       optarg);
+                usage(-3);
+            }
+            break;
+
+        case 'o':
+            opt->trace_file = optarg;
+            break;
+
+        case 'P':
+            opt->pin = optarg;
+            break;
+
         case '?':
         case 'h':
             usage(0);
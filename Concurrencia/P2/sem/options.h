@@ -6,6 +6,10 @@ struct options {
 	int customers;
 	int cut_time; // time that it takes to cut the hair (in usecs)
 	int seats;
+	int patience; // time a seated customer waits for a barber before leaving (in usecs, 0: forever)
+	int trace;           // enum trace_mode
+	char *trace_file;    // trace output (NULL: default for the mode)
+	char *pin;           // thread placement: none, compact, scatter or a CPU list
 };
 
 int read_options(int argc, char **argv, struct options *opt);
@@ -1,5 +1,6 @@
 #include "sem.h"
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
@@ -11,10 +12,16 @@ int sem_init(sem_t *s, int value) {
     if (pthread_mutex_init(&s->mutex, NULL) != 0) {
         return -1;
     }
-    if (pthread_cond_init(&s->cond, NULL) != 0) {
+    //Timed waits take CLOCK_MONOTONIC deadlines, so the condition has to measure time with that clock
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    if (pthread_cond_init(&s->cond, &attr) != 0) {
+        pthread_condattr_destroy(&attr);
         pthread_mutex_destroy(&s->mutex);
         return -1;
     }
+    pthread_condattr_destroy(&attr);
     s->count = value;
     return 0;
 }
@@ -64,6 +71,7 @@ int sem_tryp(sem_t *s) { // 0 on sucess, -1 if already locked
     pthread_mutex_lock(&s->mutex);
 
     if (s->count == 0) {
+        pthread_mutex_unlock(&s->mutex);
         return -1;
     }
     s->count--;
@@ -71,3 +79,25 @@ int sem_tryp(sem_t *s) { // 0 on sucess, -1 if already locked
     pthread_mutex_unlock(&s->mutex);
     return 0;
 }
+
+int sem_timedp(sem_t *s, const struct timespec *deadline) { // 0 on sucess, -1 if the deadline passed first
+    if (s == NULL || deadline == NULL) {
+        return -1;
+    }
+    pthread_mutex_lock(&s->mutex);
+
+    while (s->count == 0) {
+        if (pthread_cond_timedwait(&s->cond, &s->mutex, deadline) == ETIMEDOUT) {
+            //A sem_v may have come with the timeout, take the value if it is there
+            if (s->count > 0) {
+                break;
+            }
+            pthread_mutex_unlock(&s->mutex);
+            return -1;
+        }
+    }
+    s->count--;
+
+    pthread_mutex_unlock(&s->mutex);
+    return 0;
+}
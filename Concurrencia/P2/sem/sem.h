@@ -2,6 +2,7 @@
 #define __SEM_H__
 
 #include <pthread.h>
+#include <time.h>
 
 typedef struct sem_t {
     pthread_mutex_t mutex;  //To ensure a save access to the count variable
@@ -15,5 +16,6 @@ int sem_destroy(sem_t *s);
 int sem_p(sem_t *s);
 int sem_v(sem_t *s);
 int sem_tryp(sem_t *s); // 0 on sucess, -1 if already locked
+int sem_timedp(sem_t *s, const struct timespec *deadline); // 0 on sucess, -1 if the CLOCK_MONOTONIC deadline passed first
 
 #endif
\ No newline at end of file
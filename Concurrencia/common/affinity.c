@@ -0,0 +1,253 @@
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include "affinity.h"
+
+#define SYSFS_CPU  "/sys/devices/system/cpu"
+#define SYSFS_NODE "/sys/devices/system/node"
+#define MAX_NODES  64
+
+// Location of a CPU in the machine
+struct cpu_info {
+    int cpu;
+    int node;
+    int package;
+    int core;
+    int sibling;    // Rank among the SMT siblings of its core
+    int rank;       // scatter: rank among the CPUs of its package with the same sibling rank
+};
+
+// Read a single integer from a sysfs file. Returns def if the file does not exist
+static int read_sysfs_int(const char *path, int def)
+{
+    FILE *f = fopen(path, "r");
+    int v;
+
+    if (f == NULL)
+        return def;
+    if (fscanf(f, "%d", &v) != 1)
+        v = def;
+    fclose(f);
+    return v;
+}
+
+// Parse a CPU list in the kernel format (0-3,8,10-11) into set. Returns -1 if it is not valid
+static int parse_cpulist(const char *list, cpu_set_t *set)
+{
+    const char *p = list;
+    char *end;
+    long lo, hi;
+
+    CPU_ZERO(set);
+    while (*p != '\0' && *p != '\n') {
+        lo = strtol(p, &end, 10);
+        if (end == p || lo < 0)
+            return -1;
+        hi = lo;
+        if (*end == '-') {
+            p = end + 1;
+            hi = strtol(p, &end, 10);
+            if (end == p || hi < lo)
+                return -1;
+        }
+        if (hi >= CPU_SETSIZE)
+            return -1;
+        for (long c = lo; c <= hi; c++)
+            CPU_SET(c, set);
+        if (*end == ',')
+            end++;
+        else if (*end != '\0' && *end != '\n')
+            return -1;
+        p = end;
+    }
+    return 0;
+}
+
+// NUMA node of cpu, 0 on machines without node information
+static int cpu_node(int cpu)
+{
+    char path[128], line[4096];
+    cpu_set_t set;
+    FILE *f;
+
+    for (int node = 0; node < MAX_NODES; node++) {
+        snprintf(path, sizeof(path), SYSFS_NODE "/node%d/cpulist", node);
+        if ((f = fopen(path, "r")) == NULL)
+            continue;
+        if (fgets(line, sizeof(line), f) != NULL && parse_cpulist(line, &set) == 0 && CPU_ISSET(cpu, &set)) {
+            fclose(f);
+            return node;
+        }
+        fclose(f);
+    }
+    return 0;
+}
+
+static int cmp_compact(const void *p1, const void *p2)
+{
+    const struct cpu_info *a = p1, *b = p2;
+
+    if (a->node != b->node)
+        return a->node - b->node;
+    if (a->package != b->package)
+        return a->package - b->package;
+    if (a->core != b->core)
+        return a->core - b->core;
+    return a->cpu - b->cpu;
+}
+
+// First SMT sibling of every core before the second ones, and the n-th core of every package before the
+// (n+1)-th ones
+static int cmp_scatter(const void *p1, const void *p2)
+{
+    const struct cpu_info *a = p1, *b = p2;
+
+    if (a->sibling != b->sibling)
+        return a->sibling - b->sibling;
+    if (a->rank != b->rank)
+        return a->rank - b->rank;
+    return cmp_compact(p1, p2);
+}
+
+static int same_package(struct cpu_info *a, struct cpu_info *b)
+{
+    return a->node == b->node && a->package == b->package;
+}
+
+int affinity_init(struct affinity *a, const char *spec)
+{
+    struct cpu_info *info;
+    cpu_set_t usable, wanted;
+    char path[128];
+    int n = 0, i, k;
+
+    memset(a, 0, sizeof(*a));
+    if (strcmp(spec, "none") == 0) {
+        a->mode = PIN_NONE;
+    } else if (strcmp(spec, "compact") == 0) {
+        a->mode = PIN_COMPACT;
+    } else if (strcmp(spec, "scatter") == 0) {
+        a->mode = PIN_SCATTER;
+    } else {
+        a->mode = PIN_LIST;
+        if (parse_cpulist(spec, &wanted) != 0)
+            return -1;
+    }
+
+    // Topology of the CPUs this process is allowed to use
+    if (sched_getaffinity(0, sizeof(usable), &usable) != 0)
+        return -1;
+    info = malloc(CPU_COUNT(&usable) * sizeof(struct cpu_info));
+    if (info == NULL)
+        return -1;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &usable))
+            continue;
+        info[n].cpu = cpu;
+        info[n].node = cpu_node(cpu);
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/topology/physical_package_id", cpu);
+        info[n].package = read_sysfs_int(path, 0);
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/topology/core_id", cpu);
+        info[n].core = read_sysfs_int(path, cpu);
+        n++;
+    }
+
+    a->num_usable = n;
+
+    // In compact order, count the nodes, packages and cores and number the siblings of each core
+    qsort(info, n, sizeof(struct cpu_info), cmp_compact);
+    for (i = 0; i < n; i++) {
+        if (i > 0 && same_package(&info[i], &info[i - 1]) && info[i].core == info[i - 1].core)
+            info[i].sibling = info[i - 1].sibling + 1;
+        else
+            info[i].sibling = 0;
+        if (i == 0 || info[i].node != info[i - 1].node)
+            a->num_nodes++;
+        if (i == 0 || !same_package(&info[i], &info[i - 1]))
+            a->num_packages++;
+        if (info[i].sibling == 0)
+            a->num_cores++;
+    }
+
+    a->order = malloc(n * sizeof(int));
+    if (a->order == NULL) {
+        free(info);
+        return -1;
+    }
+
+    switch (a->mode) {
+    case PIN_NONE:
+    case PIN_COMPACT:
+        for (i = 0; i < n; i++)
+            a->order[i] = info[i].cpu;
+        a->num_cpus = n;
+        break;
+
+    case PIN_SCATTER:
+        // Number the cores of each package among those with the same sibling rank, then take the
+        // first core of every package, the second one of every package, and so on
+        for (i = 0; i < n; i++) {
+            info[i].rank = 0;
+            for (k = 0; k < i; k++) {
+                if (same_package(&info[k], &info[i]) && info[k].sibling == info[i].sibling)
+                    info[i].rank++;
+            }
+        }
+        qsort(info, n, sizeof(struct cpu_info), cmp_scatter);
+        for (i = 0; i < n; i++)
+            a->order[i] = info[i].cpu;
+        a->num_cpus = n;
+        break;
+
+    case PIN_LIST:
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &wanted) && CPU_ISSET(cpu, &usable))
+                a->order[a->num_cpus++] = cpu;
+        }
+        break;
+    }
+
+    free(info);
+    return a->num_cpus > 0 ? 0 : -1;
+}
+
+void affinity_destroy(struct affinity *a)
+{
+    free(a->order);
+    a->order = NULL;
+}
+
+int affinity_cpu(struct affinity *a, int n)
+{
+    if (a->mode == PIN_NONE)
+        return -1;
+    return a->order[n % a->num_cpus];
+}
+
+void affinity_attr(struct affinity *a, int n, pthread_attr_t *attr)
+{
+    cpu_set_t set;
+    int cpu = affinity_cpu(a, n);
+
+    pthread_attr_init(attr);
+    if (cpu < 0)
+        return;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+}
+
+void affinity_print(struct affinity *a, FILE *f, const char *prefix)
+{
+    static const char *modes[] = {"none", "compact", "scatter", "list"};
+
+    fprintf(f, "%stopology: %d cpus, %d cores, %d packages, %d numa nodes; pin=%s",
+        prefix, a->num_usable, a->num_cores, a->num_packages, a->num_nodes, modes[a->mode]);
+    if (a->mode != PIN_NONE) {
+        fprintf(f, " cpus");
+        for (int i = 0; i < a->num_cpus; i++)
+            fprintf(f, "%c%d", i == 0 ? ' ' : ',', a->order[i]);
+    }
+    fprintf(f, "\n");
+}
@@ -0,0 +1,52 @@
+#ifndef __AFFINITY_H__
+#define __AFFINITY_H__
+
+#include <pthread.h>
+#include <stdio.h>
+
+/*
+ * affinity.c and affinity.h:
+ * Thread placement. The CPU topology (NUMA node, package and core of each
+ * CPU the process may run on) is read from sysfs, and threads are given a
+ * fixed CPU each:
+ *   compact: fill the SMT siblings of a core, then the cores of a package,
+ *            then the next package
+ *   scatter: spread threads over packages first, then over cores, and only
+ *            then over SMT siblings
+ *   a CPU list such as 0-3,8,10: use those CPUs, in increasing order
+ * Thread n gets the n-th CPU of the order, wrapping around when there are
+ * more threads than CPUs.
+ */
+
+enum pin_mode {
+	PIN_NONE,     // threads are placed by the kernel
+	PIN_COMPACT,
+	PIN_SCATTER,
+	PIN_LIST,
+};
+
+struct affinity {
+	int mode;           // enum pin_mode
+	int num_cpus;       // CPUs in order
+	int *order;         // CPU given to each thread, in thread order
+	int num_usable;     // CPUs the process may run on
+	int num_nodes;      // NUMA nodes, packages and cores seen among the usable CPUs
+	int num_packages;
+	int num_cores;
+};
+
+// Parse a --pin argument (none, compact, scatter or a CPU list) and compute the CPU order. Returns -1 if
+// the argument is not valid or names no usable CPU
+int affinity_init(struct affinity *a, const char *spec);
+void affinity_destroy(struct affinity *a);
+
+// CPU of thread n, or -1 when threads are not pinned
+int affinity_cpu(struct affinity *a, int n);
+
+// Initialize attr to create thread n on its CPU
+void affinity_attr(struct affinity *a, int n, pthread_attr_t *attr);
+
+// Describe the topology and the placement in one line, starting with prefix
+void affinity_print(struct affinity *a, FILE *f, const char *prefix);
+
+#endif
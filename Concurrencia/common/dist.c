@@ -0,0 +1,102 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dist.h"
+
+#define ZETA_EXACT_TERMS 10000000   // Terms of zeta(n) added one by one; the rest are approximated
+
+// Uniform double in [0, 1), from the 53 high bits of the generator
+static double unit(struct rng *r)
+{
+    return (rng_next(r) >> 11) * 0x1.0p-53;
+}
+
+// Sum of 1 / k^theta for k = 1..n. Past ZETA_EXACT_TERMS the tail is replaced by its Euler-Maclaurin
+// approximation, which is far below the sampling error there and keeps billion-position buffers quick to set up
+static double zeta(long n, double theta)
+{
+    long exact = n < ZETA_EXACT_TERMS ? n : ZETA_EXACT_TERMS;
+    double sum = 0;
+
+    for (long k = 1; k <= exact; k++)
+        sum += pow(k, -theta);
+    if (n > exact) {
+        double a = exact + 1;
+        sum += (pow(n, 1 - theta) - pow(a, 1 - theta)) / (1 - theta) + (pow(a, -theta) + pow(n, -theta)) / 2;
+    }
+    return sum;
+}
+
+int dist_init(struct dist *d, const char *spec, long size)
+{
+    char *end;
+
+    memset(d, 0, sizeof(*d));
+    d->size = size;
+
+    if (strcmp(spec, "uniform") == 0) {
+        d->kind = DIST_UNIFORM;
+        return 0;
+    }
+
+    if (strncmp(spec, "zipf:", 5) == 0) {
+        d->kind = DIST_ZIPF;
+        d->theta = strtod(spec + 5, &end);
+        if (end == spec + 5 || *end != '\0' || d->theta <= 0 || d->theta >= 1)
+            return -1;
+        d->alpha = 1 / (1 - d->theta);
+        d->zetan = zeta(size, d->theta);
+        d->eta = (1 - pow(2.0 / size, 1 - d->theta)) / (1 - zeta(2, d->theta) / d->zetan);
+        d->half_pow = 1 + pow(0.5, d->theta);
+        return 0;
+    }
+
+    if (strncmp(spec, "hotspot:", 8) == 0) {
+        double frac = strtod(spec + 8, &end);
+
+        d->kind = DIST_HOTSPOT;
+        d->hot_prob = 0.8;
+        if (end == spec + 8 || frac <= 0 || frac >= 1)
+            return -1;
+        if (*end == ':') {
+            const char *p = end + 1;
+            d->hot_prob = strtod(p, &end);
+            if (end == p || d->hot_prob < 0 || d->hot_prob > 1)
+                return -1;
+        }
+        if (*end != '\0')
+            return -1;
+        d->hot_size = frac * size;
+        if (d->hot_size == 0)
+            d->hot_size = 1;
+        return 0;
+    }
+
+    return -1;
+}
+
+long dist_sample(const struct dist *d, struct rng *r)
+{
+    double u, uz;
+    long k;
+
+    switch (d->kind) {
+    case DIST_ZIPF:
+        u = unit(r);
+        uz = u * d->zetan;
+        if (uz < 1)
+            return 0;
+        if (uz < d->half_pow)
+            return d->size > 1 ? 1 : 0;
+        k = d->size * pow(d->eta * u - d->eta + 1, d->alpha);
+        return k < d->size ? k : d->size - 1;
+
+    case DIST_HOTSPOT:
+        if (d->hot_size == d->size || unit(r) < d->hot_prob)
+            return rng_below(r, d->hot_size);
+        return d->hot_size + rng_below(r, d->size - d->hot_size);
+
+    default:
+        return rng_below(r, d->size);
+    }
+}
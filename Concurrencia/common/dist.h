@@ -0,0 +1,44 @@
+#ifndef __DIST_H__
+#define __DIST_H__
+
+#include "rng.h"
+
+/*
+ * dist.c and dist.h:
+ * Distributions of the positions picked by the swap threads:
+ *   uniform          every position is equally likely
+ *   zipf:θ           position k is picked with probability proportional to
+ *                    1 / (k + 1)^θ, 0 < θ < 1. Sampled in O(1) with the
+ *                    method of Gray et al., "Quickly generating
+ *                    billion-record synthetic databases" (SIGMOD 1994)
+ *   hotspot:f[:p]    the first f·size positions get a fraction p (0.8 by
+ *                    default) of the accesses, uniformly
+ * The constants are computed once by dist_init() and only read afterwards,
+ * so every thread samples from the same struct dist with its own rng.
+ */
+
+enum dist_kind {
+	DIST_UNIFORM,
+	DIST_ZIPF,
+	DIST_HOTSPOT,
+};
+
+struct dist {
+	int kind;           // enum dist_kind
+	long size;          // positions are sampled from [0, size)
+	double theta;       // zipf
+	double alpha;       // zipf: 1 / (1 - theta)
+	double zetan;       // zipf: sum of 1 / k^theta for k = 1..size
+	double eta;         // zipf
+	double half_pow;    // zipf: probability of the two hottest positions, in the scale of zetan
+	long hot_size;      // hotspot: positions in the hot set
+	double hot_prob;    // hotspot: fraction of the accesses that go to the hot set
+};
+
+// Parse a distribution spec and precompute its constants for size positions. Returns -1 if it is not valid
+int dist_init(struct dist *d, const char *spec, long size);
+
+// Position in [0, size) drawn from the distribution
+long dist_sample(const struct dist *d, struct rng *r);
+
+#endif
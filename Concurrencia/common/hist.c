@@ -0,0 +1,61 @@
+#include <string.h>
+#include "hist.h"
+
+void hist_reset(struct hist *h)
+{
+    memset(h, 0, sizeof(*h));
+}
+
+// Values below HIST_SUB_BUCKETS get a bucket each. Above that, the position of the highest bit selects the
+// power of two and the next HIST_SUB_BITS bits the linear bucket inside it
+static int bucket_of(uint64_t v)
+{
+    int msb;
+
+    if (v < HIST_SUB_BUCKETS)
+        return v;
+    msb = 63 - __builtin_clzll(v);
+    return (msb - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS + ((v >> (msb - HIST_SUB_BITS)) & (HIST_SUB_BUCKETS - 1));
+}
+
+// Smallest value that falls in bucket b
+static uint64_t bucket_low(int b)
+{
+    int range = b / HIST_SUB_BUCKETS;
+    int sub = b % HIST_SUB_BUCKETS;
+
+    if (range == 0)
+        return sub;
+    return (uint64_t) (HIST_SUB_BUCKETS + sub) << (range - 1);
+}
+
+void hist_record(struct hist *h, uint64_t value)
+{
+    h->buckets[bucket_of(value)]++;
+    h->count++;
+}
+
+void hist_merge(struct hist *dst, const struct hist *src)
+{
+    for (int b = 0; b < HIST_BUCKETS; b++)
+        dst->buckets[b] += src->buckets[b];
+    dst->count += src->count;
+}
+
+uint64_t hist_percentile(const struct hist *h, double p)
+{
+    uint64_t rank, seen = 0;
+
+    if (h->count == 0)
+        return 0;
+
+    rank = p * h->count;
+    if (rank >= h->count)
+        rank = h->count - 1;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen > rank)
+            return bucket_low(b);
+    }
+    return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef __HIST_H__
+#define __HIST_H__
+
+#include <stdint.h>
+
+/*
+ * hist.c and hist.h:
+ * Log-linear latency histogram. Each power of two is split into
+ * HIST_SUB_BUCKETS linear buckets, so a percentile is known within about 6%
+ * whatever its magnitude. Each thread fills its own histogram and they are
+ * merged at the end, so recording a value needs no synchronization.
+ */
+
+#define HIST_SUB_BITS    4
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS     ((64 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+struct hist {
+	uint64_t count;
+	uint64_t buckets[HIST_BUCKETS];
+};
+
+void hist_reset(struct hist *h);
+void hist_record(struct hist *h, uint64_t value);
+
+// Add the values of src to dst
+void hist_merge(struct hist *dst, const struct hist *src);
+
+// Value below which a fraction p (0..1) of the recorded values are, 0 if there are none
+uint64_t hist_percentile(const struct hist *h, double p);
+
+#endif
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "lock_prof.h"
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void record(uint64_t *hist, uint64_t ns)
+{
+    int b = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+
+    hist[b < PROF_BUCKETS ? b : PROF_BUCKETS - 1]++;
+}
+
+// Upper bound of the bucket that holds the fraction p of the values (in ns), 0 for waits that did not happen
+static uint64_t percentile(const uint64_t *hist, uint64_t count, double p)
+{
+    uint64_t seen = 0;
+
+    for (int b = 0; b < PROF_BUCKETS; b++) {
+        seen += hist[b];
+        if (seen > p * count)
+            return b == 0 ? 0 : (uint64_t) 1 << b;
+    }
+    return 0;
+}
+
+struct lock_prof *lock_prof_alloc(const char *name, long n)
+{
+    struct lock_prof *p = aligned_alloc(alignof(struct lock_prof), n * sizeof(struct lock_prof));
+
+    if (p == NULL) {
+        printf("Out of memory for the lock profile\n");
+        exit(1);
+    }
+    for (long i = 0; i < n; i++) {
+        p[i] = (struct lock_prof) { .name = name, .index = i };
+    }
+    return p;
+}
+
+void lock_prof_acquire(pthread_mutex_t *m, struct lock_prof *p)
+{
+    uint64_t start, wait = 0;
+    int contended = 0;
+
+    // Only a failed trylock has to be timed
+    if (pthread_mutex_trylock(m) != 0) {
+        start = now_ns();
+        pthread_mutex_lock(m);
+        wait = now_ns() - start;
+        contended = 1;
+    }
+
+    p->acquisitions++;
+    p->contended += contended;
+    p->wait_ns += wait;
+    record(p->wait_hist, wait);
+    p->locked_at = now_ns();
+}
+
+void lock_prof_release(pthread_mutex_t *m, struct lock_prof *p)
+{
+    uint64_t hold = now_ns() - p->locked_at;
+
+    p->hold_ns += hold;
+    record(p->hold_hist, hold);
+    pthread_mutex_unlock(m);
+}
+
+// Most contended first, then most time waited
+static int cmp_contention(const void *p1, const void *p2)
+{
+    const struct lock_prof *a = *(struct lock_prof * const *) p1;
+    const struct lock_prof *b = *(struct lock_prof * const *) p2;
+
+    if (a->contended != b->contended)
+        return a->contended < b->contended ? 1 : -1;
+    if (a->wait_ns != b->wait_ns)
+        return a->wait_ns < b->wait_ns ? 1 : -1;
+    return 0;
+}
+
+void lock_prof_report(struct lock_prof **profs, long n)
+{
+    uint64_t acquisitions = 0, contended = 0;
+
+    qsort(profs, n, sizeof(struct lock_prof *), cmp_contention);
+    for (long i = 0; i < n; i++) {
+        acquisitions += profs[i]->acquisitions;
+        contended += profs[i]->contended;
+    }
+
+    printf("lock profile: %ld locks, %lu acquisitions, %lu contended (%.1f%%)\n", n,
+           (unsigned long) acquisitions, (unsigned long) contended,
+           acquisitions ? 100.0 * contended / acquisitions : 0);
+    printf("%-20s %12s %12s %8s %12s %10s %10s %10s %10s\n", "lock", "acquired", "contended", "%",
+           "wait total", "wait p50", "wait p99", "hold p50", "hold p99");
+    for (long i = 0; i < n && i < PROF_TOP && profs[i]->acquisitions > 0; i++) {
+        struct lock_prof *p = profs[i];
+        char name[64];
+
+        snprintf(name, sizeof(name), "%s[%ld]", p->name, p->index);
+        printf("%-20s %12lu %12lu %7.1f%% %10.3fms %8luns %8luns %8luns %8luns\n", name,
+               (unsigned long) p->acquisitions, (unsigned long) p->contended,
+               100.0 * p->contended / p->acquisitions, p->wait_ns / 1e6,
+               (unsigned long) percentile(p->wait_hist, p->acquisitions, 0.50),
+               (unsigned long) percentile(p->wait_hist, p->acquisitions, 0.99),
+               (unsigned long) percentile(p->hold_hist, p->acquisitions, 0.50),
+               (unsigned long) percentile(p->hold_hist, p->acquisitions, 0.99));
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef __LOCK_PROF_H__
+#define __LOCK_PROF_H__
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdint.h>
+
+/*
+ * lock_prof.c and lock_prof.h:
+ * Lock contention profiler. Built with -DLOCK_PROFILE (make PROFILE=1),
+ * prof_lock() and prof_unlock() count the acquisitions of each lock, how
+ * many of them had to wait, and log2 histograms of the time spent waiting
+ * for the lock and holding it. The statistics of a lock are only updated
+ * while holding it, so they need no synchronization of their own.
+ * Without LOCK_PROFILE both macros are plain pthread_mutex_lock() and
+ * pthread_mutex_unlock() calls and struct lock_prof is never touched.
+ */
+
+#define PROF_BUCKETS 40    // Bucket b holds times in [2^(b-1), 2^b) ns; the last one everything above
+#define PROF_TOP     10    // Locks shown by lock_prof_report()
+
+struct lock_prof {
+	alignas(64) const char *name;     // Lock name and index, for the report
+	long index;
+	uint64_t acquisitions;
+	uint64_t contended;            // Acquisitions that found the lock taken
+	uint64_t wait_ns;              // Total time spent waiting and holding
+	uint64_t hold_ns;
+	uint64_t locked_at;            // When the current holder got the lock
+	uint64_t wait_hist[PROF_BUCKETS];
+	uint64_t hold_hist[PROF_BUCKETS];
+};
+
+#ifdef LOCK_PROFILE
+#define prof_lock(m, p)   lock_prof_acquire(m, p)
+#define prof_unlock(m, p) lock_prof_release(m, p)
+#else
+#define prof_lock(m, p)   pthread_mutex_lock(m)
+#define prof_unlock(m, p) pthread_mutex_unlock(m)
+#endif
+
+// Allocate the statistics of n locks called name[0..n)
+struct lock_prof *lock_prof_alloc(const char *name, long n);
+
+void lock_prof_acquire(pthread_mutex_t *m, struct lock_prof *p);
+void lock_prof_release(pthread_mutex_t *m, struct lock_prof *p);
+
+// Print the PROF_TOP locks with the most contended acquisitions among the n given ones
+void lock_prof_report(struct lock_prof **profs, long n);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef __RNG_H__
+#define __RNG_H__
+
+#include <stdint.h>
+
+/*
+ * rng.c and rng.h:
+ * Per-thread xoshiro256** pseudo random generator. Unlike rand() it keeps no
+ * shared state, so threads do not serialize on libc's internal lock, and a
+ * given seed always produces the same sequence for each thread.
+ */
+
+struct rng {
+	uint64_t s[4];
+};
+
+// Seed the generator. Each stream (e.g. the thread number) gets an independent sequence for the same seed
+void rng_seed(struct rng *r, uint64_t seed, uint64_t stream);
+
+uint64_t rng_next(struct rng *r);
+
+// Uniform value in [0, n) without modulo bias. n must be > 0
+uint64_t rng_below(struct rng *r, uint64_t n);
+
+#endif
@@ -0,0 +1,168 @@
+#include "trace.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CACHE_LINE_SIZE  64
+#define TRACE_RING_SIZE  4096            // records per thread, power of two
+#define FLUSH_IDLE_US    1000            // flusher sleep when every ring is empty
+
+// Single producer / single consumer ring. head and tail live in different cache lines
+struct trace_ring {
+    alignas(CACHE_LINE_SIZE) atomic_uint head;    // next record to write, only the owner thread moves it
+    alignas(CACHE_LINE_SIZE) atomic_uint tail;    // next record to flush, only the flusher moves it
+    struct trace_record records[TRACE_RING_SIZE];
+};
+
+static int mode = TRACE_OFF;
+static FILE *out;
+static const char **formats;
+static int num_formats;
+static struct trace_ring *rings;
+static int num_rings;
+static pthread_t flusher;
+static atomic_bool stop;
+
+static void write_record(struct trace_record *r)
+{
+    if (mode == TRACE_BINARY) {
+        fwrite(r, sizeof(*r), 1, out);
+    } else if (r->event < num_formats) {
+        fprintf(out, formats[r->event], r->args[0], r->args[1], r->args[2], r->args[3], r->args[4]);
+    }
+}
+
+// Write every record published so far. Returns the number of records written
+static int drain(void)
+{
+    int written = 0;
+
+    for (int i = 0; i < num_rings; i++) {
+        struct trace_ring *ring = &rings[i];
+        unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        unsigned head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+        for (; tail != head; tail++, written++)
+            write_record(&ring->records[tail & (TRACE_RING_SIZE - 1)]);
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+    return written;
+}
+
+static void *flush_thread(void *ptr)
+{
+    while (!atomic_load(&stop)) {
+        if (drain() == 0)
+            usleep(FLUSH_IDLE_US);
+    }
+    drain();    // Records logged before trace_finish() was called
+    return NULL;
+}
+
+static int write_header(void)
+{
+    uint32_t n = num_formats;
+
+    if (fwrite(TRACE_MAGIC, strlen(TRACE_MAGIC), 1, out) != 1 || fwrite(&n, sizeof(n), 1, out) != 1)
+        return -1;
+    for (int i = 0; i < num_formats; i++) {
+        uint32_t len = strlen(formats[i]);
+
+        if (fwrite(&len, sizeof(len), 1, out) != 1 || fwrite(formats[i], len, 1, out) != 1)
+            return -1;
+    }
+    return 0;
+}
+
+int trace_init(int m, const char *path, int slots, const char **fmts, int nfmts)
+{
+    mode = m;
+    if (mode == TRACE_OFF)
+        return 0;
+
+    formats = fmts;
+    num_formats = nfmts;
+    num_rings = slots;
+
+    if (mode == TRACE_TEXT && path == NULL) {
+        out = stdout;
+    } else if ((out = fopen(path != NULL ? path : "trace.bin", mode == TRACE_BINARY ? "wb" : "w")) == NULL) {
+        return -1;
+    }
+    if (mode == TRACE_BINARY && write_header() != 0)
+        return -1;
+
+    rings = aligned_alloc(CACHE_LINE_SIZE, slots * sizeof(struct trace_ring));
+    if (rings == NULL)
+        return -1;
+    for (int i = 0; i < slots; i++) {
+        atomic_init(&rings[i].head, 0);
+        atomic_init(&rings[i].tail, 0);
+    }
+
+    atomic_init(&stop, false);
+    if (pthread_create(&flusher, NULL, flush_thread, NULL) != 0)
+        return -1;
+    return 0;
+}
+
+void trace_log(int slot, int event, const int32_t args[TRACE_MAX_ARGS])
+{
+    struct trace_ring *ring;
+    struct trace_record *r;
+    struct timespec ts;
+    unsigned head;
+
+    if (mode == TRACE_OFF || slot < 0 || slot >= num_rings)
+        return;
+
+    ring = &rings[slot];
+    head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    // Ring full: wait for the flusher instead of losing the record
+    while (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= TRACE_RING_SIZE)
+        sched_yield();
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    r = &ring->records[head & (TRACE_RING_SIZE - 1)];
+    r->time_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    r->event = event;
+    r->slot = slot;
+    memcpy(r->args, args, sizeof(r->args));
+
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void trace_finish(void)
+{
+    if (mode == TRACE_OFF)
+        return;
+
+    atomic_store(&stop, true);
+    pthread_join(flusher, NULL);
+
+    if (out == stdout)
+        fflush(out);
+    else
+        fclose(out);
+    free(rings);
+    mode = TRACE_OFF;
+}
+
+int trace_parse_mode(const char *name)
+{
+    if (strcmp(name, "off") == 0)
+        return TRACE_OFF;
+    if (strcmp(name, "text") == 0)
+        return TRACE_TEXT;
+    if (strcmp(name, "binary") == 0)
+        return TRACE_BINARY;
+    return -1;
+}
@@ -0,0 +1,52 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdint.h>
+
+/*
+ * trace.c and trace.h:
+ * Asynchronous trace log. Every thread writes fixed size records into its own
+ * lock-free ring buffer, and a background flusher thread drains the rings and
+ * does the actual output. Threads can log while holding the lock under test
+ * without paying for stdio's lock or the terminal write.
+ *
+ * Records hold an index into a table of printf formats plus up to
+ * TRACE_MAX_ARGS integer arguments. In text mode the flusher formats them.
+ * In binary mode they are dumped as they are, behind a header with the
+ * format table, and trace_decode (Concurrencia/trace_decode, shared by every
+ * program) turns the file back into text offline.
+ */
+
+enum trace_mode {
+	TRACE_OFF,
+	TRACE_TEXT,
+	TRACE_BINARY,
+};
+
+#define TRACE_MAX_ARGS 5
+
+struct trace_record {
+	uint64_t time_ns;                 // CLOCK_MONOTONIC time of the event
+	uint16_t event;                   // index in the format table
+	uint16_t slot;                    // thread that logged the event
+	int32_t  args[TRACE_MAX_ARGS];    // printf arguments, all %d
+};
+
+#define TRACE_MAGIC "CPTRACE1"
+
+// Start the flusher. path may be NULL: stdout in text mode, "trace.bin" in binary mode.
+// Returns 0 on success, -1 on error
+int trace_init(int mode, const char *path, int num_slots, const char **formats, int num_formats);
+
+// Log an event from the thread that owns slot. Only one thread may use each slot
+void trace_log(int slot, int event, const int32_t args[TRACE_MAX_ARGS]);
+
+// Stop the flusher after it has written every pending record
+void trace_finish(void);
+
+// Parse "off", "text" or "binary". Returns the mode or -1
+int trace_parse_mode(const char *name);
+
+#define TRACE(slot, event, ...) trace_log((slot), (event), (const int32_t[TRACE_MAX_ARGS]){ __VA_ARGS__ })
+
+#endif
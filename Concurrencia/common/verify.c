@@ -0,0 +1,88 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "verify.h"
+
+#define WORD_BITS 64
+
+struct verify_args {
+    pthread_t thread_id;
+    const void *data;
+    size_t elem_size;
+    long n;
+    long lo, hi;                 // Part of the buffer checked by this thread
+    atomic_ulong *bitmap;        // Values seen, shared by all threads
+    atomic_long *bad;            // First bad position found by any thread (-1: none)
+};
+
+static void *verify_part(void *ptr)
+{
+    struct verify_args *args = ptr;
+    long v;
+    unsigned long bit, old;
+
+    for (long k = args->lo; k < args->hi; k++) {
+        // Another thread already failed
+        if ((k & 4095) == 0 && atomic_load_explicit(args->bad, memory_order_relaxed) >= 0)
+            return NULL;
+
+        if (args->elem_size == sizeof(int64_t))
+            v = ((const int64_t *) args->data)[k];
+        else
+            v = ((const int32_t *) args->data)[k];
+
+        if (v >= 0 && v < args->n) {
+            bit = 1UL << (v % WORD_BITS);
+            old = atomic_fetch_or_explicit(&args->bitmap[v / WORD_BITS], bit, memory_order_relaxed);
+            if ((old & bit) == 0)
+                continue;
+        }
+
+        long none = -1;
+        atomic_compare_exchange_strong(args->bad, &none, k);
+        return NULL;
+    }
+    return NULL;
+}
+
+long verify_permutation(const void *data, size_t elem_size, long n, int num_threads)
+{
+    struct verify_args *args;
+    atomic_ulong *bitmap;
+    atomic_long bad;
+    int t;
+
+    if (num_threads < 1)
+        num_threads = 1;
+    if (num_threads > n)
+        num_threads = n > 0 ? n : 1;
+
+    bitmap = calloc((n + WORD_BITS - 1) / WORD_BITS, sizeof(atomic_ulong));
+    args = malloc(num_threads * sizeof(struct verify_args));
+    if (bitmap == NULL || args == NULL) {
+        printf("Not enough memory to verify the buffer\n");
+        exit(1);
+    }
+    atomic_init(&bad, -1);
+
+    for (t = 0; t < num_threads; t++) {
+        args[t] = (struct verify_args) {
+            .data = data, .elem_size = elem_size, .n = n,
+            .lo = n / num_threads * t,
+            .hi = t == num_threads - 1 ? n : n / num_threads * (t + 1),
+            .bitmap = bitmap, .bad = &bad,
+        };
+        if (pthread_create(&args[t].thread_id, NULL, verify_part, &args[t]) != 0) {
+            printf("Could not create verify thread #%d\n", t);
+            exit(1);
+        }
+    }
+    for (t = 0; t < num_threads; t++)
+        pthread_join(args[t].thread_id, NULL);
+
+    free(bitmap);
+    free(args);
+    return atomic_load(&bad);
+}
@@ -0,0 +1,19 @@
+#ifndef __VERIFY_H__
+#define __VERIFY_H__
+
+#include <stddef.h>
+
+/*
+ * verify.c and verify.h:
+ * Check that a buffer still holds a permutation of 0..n-1 in O(n). The
+ * buffer is split between num_threads threads, which mark every value they
+ * read in a shared bitmap. A value out of range, or one whose bit was
+ * already set, means the buffer is not a permutation; if every value is in
+ * range and none repeats, the n values are exactly 0..n-1.
+ */
+
+// Check data[0..n), with elements of elem_size bytes (4 or 8). Returns -1 if it is a permutation of 0..n-1,
+// otherwise a position holding a value out of range or repeated
+long verify_permutation(const void *data, size_t elem_size, long n, int num_threads);
+
+#endif
@@ -0,0 +1,55 @@
+#include <stdint.h>
+#include <time.h>
+#include "work.h"
+
+#define CALIBRATION_LOOPS  (1 << 20)
+#define CALIBRATION_ROUNDS 5
+
+static double loops_per_ns;
+
+// Loop n times. The empty asm makes x opaque to the compiler, so the loop is neither removed nor vectorized
+static void spin(uint64_t n)
+{
+    uint64_t x = 0;
+
+    while (n-- > 0) {
+        x += n;
+        __asm__ volatile("" : "+r"(x));
+    }
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Keep the fastest of several rounds, as the slower ones were interrupted or ran at a lower frequency
+void work_calibrate(void)
+{
+    uint64_t best = UINT64_MAX;
+
+    for (int r = 0; r < CALIBRATION_ROUNDS; r++) {
+        uint64_t start = now_ns();
+        uint64_t elapsed;
+
+        spin(CALIBRATION_LOOPS);
+        elapsed = now_ns() - start;
+        if (elapsed < best)
+            best = elapsed;
+    }
+    loops_per_ns = (double) CALIBRATION_LOOPS / (best > 0 ? best : 1);
+}
+
+double work_rate(void)
+{
+    return loops_per_ns * 1000;
+}
+
+void work_ns(unsigned ns)
+{
+    if (ns > 0)
+        spin(ns * loops_per_ns);
+}
@@ -0,0 +1,21 @@
+#ifndef __WORK_H__
+#define __WORK_H__
+
+/*
+ * work.c and work.h:
+ * Calibrated busy work. usleep() parks the thread in the kernel and wakes it
+ * tens of microseconds later, so it cannot model short critical sections.
+ * work_ns() spins on the CPU for about the requested time instead, using a
+ * loop whose speed is measured once against clock_gettime().
+ */
+
+// Measure the speed of the work loop. Call it once before work_ns()
+void work_calibrate(void);
+
+// Loop iterations per microsecond found by work_calibrate()
+double work_rate(void);
+
+// Keep the CPU busy for about ns nanoseconds
+void work_ns(unsigned ns);
+
+#endif
@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+/*
+ * trace_decode.c:
+ * Turns a binary trace written with --trace=binary back into text.
+ * Records are sorted by time first, so lines from different threads come
+ * out in the order the events happened.
+ *
+ * Usage: trace_decode [-t] <file>    (-t prefixes every line with its time in ns)
+ *
+ * Every program writes the same format, so this one decoder reads the
+ * traces of all of them. The file is not trusted: each format must be
+ * shorter than MAX_FORMAT_LEN and hold at most TRACE_MAX_ARGS %d
+ * conversions before it is given to printf.
+ */
+
+#define MAX_FORMAT_LEN 4096
+#define MAX_FORMATS    (UINT16_MAX + 1)    // Records can not refer to more
+
+static int cmp_time(const void *a, const void *b)
+{
+    const struct trace_record *ra = a, *rb = b;
+
+    if (ra->time_ns != rb->time_ns)
+        return ra->time_ns < rb->time_ns ? -1 : 1;
+    return (int)ra->slot - (int)rb->slot;
+}
+
+// Check that fmt only has %d or %i conversions (with flags, width and precision), at most TRACE_MAX_ARGS of
+// them, and %%. Returns 0 if it is safe to print with the TRACE_MAX_ARGS arguments of a record
+static int check_format(const char *fmt)
+{
+    int conversions = 0;
+
+    while ((fmt = strchr(fmt, '%')) != NULL) {
+        fmt++;
+        if (*fmt == '%') {
+            fmt++;
+            continue;
+        }
+        fmt += strspn(fmt, "-+ #0");
+        fmt += strspn(fmt, "0123456789");
+        if (*fmt == '.') {
+            fmt++;
+            fmt += strspn(fmt, "0123456789");
+        }
+        if ((*fmt != 'd' && *fmt != 'i') || ++conversions > TRACE_MAX_ARGS)
+            return -1;
+        fmt++;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    char magic[sizeof(TRACE_MAGIC) - 1];
+    char **formats;
+    uint32_t num_formats;
+    struct trace_record *records = NULL;
+    size_t num_records = 0, capacity = 0;
+    int timestamps = 0;
+    FILE *in;
+
+    if (argc == 3 && strcmp(argv[1], "-t") == 0) {
+        timestamps = 1;
+        argv++;
+        argc--;
+    }
+    if (argc != 2) {
+        printf("Usage: trace_decode [-t] <file>\n");
+        exit(-1);
+    }
+    if ((in = fopen(argv[1], "rb")) == NULL) {
+        printf("Could not open %s\n", argv[1]);
+        exit(1);
+    }
+
+    if (fread(magic, sizeof(magic), 1, in) != 1 || memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0
+        || fread(&num_formats, sizeof(num_formats), 1, in) != 1) {
+        printf("%s: not a trace file\n", argv[1]);
+        exit(1);
+    }
+
+    // Format table
+    if (num_formats > MAX_FORMATS) {
+        printf("%s: corrupted header\n", argv[1]);
+        exit(1);
+    }
+    if ((formats = malloc(num_formats * sizeof(char *))) == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    for (uint32_t i = 0; i < num_formats; i++) {
+        uint32_t len;
+
+        if (fread(&len, sizeof(len), 1, in) != 1 || len >= MAX_FORMAT_LEN || (formats[i] = malloc(len + 1)) == NULL
+            || (len > 0 && fread(formats[i], len, 1, in) != 1)) {
+            printf("%s: corrupted header\n", argv[1]);
+            exit(1);
+        }
+        formats[i][len] = '\0';
+        if (check_format(formats[i]) != 0) {
+            printf("%s: format %u is not a trace format\n", argv[1], i);
+            exit(1);
+        }
+    }
+
+    // Records
+    while (1) {
+        if (num_records == capacity) {
+            capacity = capacity ? capacity * 2 : 4096;
+            if ((records = realloc(records, capacity * sizeof(struct trace_record))) == NULL) {
+                printf("Out of memory\n");
+                exit(1);
+            }
+        }
+        if (fread(&records[num_records], sizeof(struct trace_record), 1, in) != 1)
+            break;
+        num_records++;
+    }
+    fclose(in);
+
+    qsort(records, num_records, sizeof(struct trace_record), cmp_time);
+
+    for (size_t i = 0; i < num_records; i++) {
+        struct trace_record *r = &records[i];
+
+        if (r->event >= num_formats)
+            continue;
+        if (timestamps)
+            printf("%llu ", (unsigned long long)r->time_ns);
+        printf(formats[r->event], r->args[0], r->args[1], r->args[2], r->args[3], r->args[4]);
+    }
+
+    for (uint32_t i = 0; i < num_formats; i++)
+        free(formats[i]);
+    free(formats);
+    free(records);
+    return 0;
+}